@@ -0,0 +1,69 @@
+#ifdef CMAKE
+#include <cstring>
+#include <cmath>
+#endif
+
+#include "DeltaCalculator.h"
+
+using namespace firestep;
+
+#define DELTA_TAN30 0.577350269
+#define DELTA_SIN120 0.866025404
+#define DELTA_COS120 -0.5
+
+DeltaCalculator::DeltaCalculator(float e, float f, float re, float rf,
+                                 float gearRatio, int16_t steps, uint8_t microsteps)
+    : e(e), f(f), re(re), rf(rf) {
+	yBase = -0.5 * DELTA_TAN30 * f;
+	yEffector = 0.5 * DELTA_TAN30 * e;
+	kLink = rf * rf - re * re - yBase * yBase;
+	degreePulses = gearRatio * steps * microsteps / 360.0;
+}
+
+/**
+ * Set degrees to the angle below horizontal of the base arm in the YZ plane
+ * for the effector center at (x,y,z). The effector must be below the base.
+ */
+Status DeltaCalculator::calcAngleYZ(float x, float y, float z, float &degrees) {
+	if (z >= 0) {
+		return STATUS_KINEMATIC_XYZ;
+	}
+	y -= yEffector; // shift center to edge
+	// base arm joint lies on z = a + b*y
+	float a = (x * x + y * y + z * z + kLink) / (2 * z);
+	float b = (yBase - y) / z;
+	float aby = a + b * yBase;
+	float d = rf * (b * b * rf + rf) - aby * aby;
+	if (d < 0) {
+		return STATUS_KINEMATIC_XYZ;
+	}
+	float yj = (yBase - a * b - sqrt(d)) / (b * b + 1); // choose outer joint
+	float zj = a + b * yj;
+	degrees = atan(-zj / (yBase - yj)) * (180 / M_PI) + ((yj > yBase) ? 180.0 : 0.0);
+	return STATUS_OK;
+}
+
+/**
+ * Set pulses to the motor positions for the given effector position
+ */
+Status DeltaCalculator::calcPulses(const XYZ &xyz, Quad<StepCoord> &pulses) {
+	float degrees[3];
+	Status status = calcAngleYZ(xyz.x, xyz.y, xyz.z, degrees[0]); // back arm frame
+	if (status == STATUS_OK) { // front left arm frame
+		status = calcAngleYZ(xyz.x * DELTA_COS120 + xyz.y * DELTA_SIN120,
+		                     xyz.y * DELTA_COS120 - xyz.x * DELTA_SIN120, xyz.z, degrees[1]);
+	}
+	if (status == STATUS_OK) { // front right arm frame
+		status = calcAngleYZ(xyz.x * DELTA_COS120 - xyz.y * DELTA_SIN120,
+		                     xyz.y * DELTA_COS120 + xyz.x * DELTA_SIN120, xyz.z, degrees[2]);
+	}
+	if (status != STATUS_OK) {
+		return status;
+	}
+	for (QuadIndex i = 0; i < 3; i++) {
+		float p = degrees[i] * degreePulses;
+		pulses.value[i] = p < 0 ? p - 0.5 : p + 0.5;
+	}
+	pulses.value[3] = 0;
+	return STATUS_OK;
+}
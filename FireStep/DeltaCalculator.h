@@ -0,0 +1,55 @@
+#ifndef DELTACALCULATOR_H
+#define DELTACALCULATOR_H
+
+#include "Status.h"
+#include "Stroke.h"
+
+namespace firestep {
+
+// FirePick Delta geometry (PC1_EMC01)
+#define DELTA_E 131.636 /* effector equilateral triangle side (mm) */
+#define DELTA_F 190.526 /* base equilateral triangle side (mm) */
+#define DELTA_RE 270.000 /* effector arm length (mm) */
+#define DELTA_RF 90.000 /* base arm length (mm) */
+#define DELTA_GEAR_RATIO (150/16.0) /* base arm pulley teeth per motor pulley teeth */
+#define DELTA_STEPS 200 /* motor full steps per revolution */
+#define DELTA_MICROSTEPS 16 /* motor microsteps per full step */
+
+typedef class XYZ {
+    public:
+        float x;
+        float y;
+        float z;
+    public:
+        XYZ(float x = 0, float y = 0, float z = 0) : x(x), y(y), z(z) {}
+} XYZ;
+
+/**
+ * Delta robot inverse kinematics. Motor pulses are measured from the
+ * horizontal base arm position. Motors 0, 1 and 2 drive the back,
+ * front left and front right arms. Motor 3 is not used.
+ */
+typedef class DeltaCalculator {
+    private:
+        float	e;				// effector equilateral triangle side
+        float	f;				// base equilateral triangle side
+        float	re;				// effector arm length
+        float	rf;				// base arm length
+        float	yBase;			// base arm joint y: -f/(2*sqrt(3))
+        float	yEffector;		// effector arm joint y offset: e/(2*sqrt(3))
+        float	kLink;			// rf*rf - re*re - yBase*yBase
+        float	degreePulses;	// motor pulses per base arm degree
+        Status calcAngleYZ(float x, float y, float z, float &degrees);
+    public:
+        DeltaCalculator(float e = DELTA_E, float f = DELTA_F, float re = DELTA_RE, float rf = DELTA_RF,
+                        float gearRatio = DELTA_GEAR_RATIO, int16_t steps = DELTA_STEPS,
+                        uint8_t microsteps = DELTA_MICROSTEPS);
+        Status calcPulses(const XYZ &xyz, Quad<StepCoord> &pulses);
+        inline float getDegreePulses() {
+            return degreePulses;
+        }
+} DeltaCalculator;
+
+} // namespace firestep
+
+#endif
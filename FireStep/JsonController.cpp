@@ -11,6 +11,9 @@ using namespace firestep;
 JsonController::JsonController(Machine& machine)
     : machine(machine) {
     lastProcessed = 0;
+#ifdef STROKE_GENERATOR
+    parkedLine = false;
+#endif
 }
 
 Status JsonController::setup() {
@@ -114,8 +117,58 @@ Status JsonController::processStepperPosition(JsonCommand &jcmd, JsonObject& job
     return status;
 }
 
-Status JsonController::initializeStrokeArray(JsonCommand &jcmd,
+static int8_t base64Value(char c) {
+    if ('A' <= c && c <= 'Z') {
+        return c - 'A';
+    }
+    if ('a' <= c && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if ('0' <= c && c <= '9') {
+        return c - '0' + 52;
+    }
+    switch (c) {
+    case '+':
+        return 62;
+    case '/':
+        return 63;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Initialize motor segments from a JSON array of int8 values,
+ * or from a JSON string of base64 packed int8 values
+ */
+Status JsonController::initializeStrokeArray(JsonCommand &jcmd, Stroke &strokeBuf,
         JsonObject& stroke, const char *key, MotorIndex iMotor, int16_t &slen) {
+    const char *s = stroke[key];
+    if (s) {
+        uint16_t bits = 0;
+        uint8_t nBits = 0;
+        for (; *s && *s != '='; s++) {
+            int8_t v = base64Value(*s);
+            if (v < 0) {
+                return jcmd.setError(STATUS_FIELD_BASE64, key);
+            }
+            bits = (bits << 6) | v;
+            nBits += 6;
+            if (nBits >= 8) {
+                nBits -= 8;
+                StepDV dv = (StepDV) (uint8_t) (bits >> nBits);
+                if (dv < -127) {
+                    return jcmd.setError(STATUS_RANGE_ERROR, key);
+                }
+                if (slen >= SEGMENT_COUNT) {
+                    return jcmd.setError(STATUS_STROKE_MAXLEN, key);
+                }
+                strokeBuf.seg[slen++].value[iMotor] = dv;
+            }
+        }
+        stroke[key] = (int32_t) 0;
+        return STATUS_BUSY_MOVING;
+    }
     JsonArray &jarr = stroke[key];
     if (!jarr.success()) {
         return jcmd.setError(STATUS_FIELD_ARRAY_ERROR, key);
@@ -124,7 +177,10 @@ Status JsonController::initializeStrokeArray(JsonCommand &jcmd,
         if (*it2 < -127 || 127 < *it2) {
             return jcmd.setError(STATUS_RANGE_ERROR, key);
         }
-        machine.stroke.seg[slen++].value[iMotor] = (StepDV) (int32_t) * it2;
+        if (slen >= SEGMENT_COUNT) {
+            return jcmd.setError(STATUS_STROKE_MAXLEN, key);
+        }
+        strokeBuf.seg[slen++].value[iMotor] = (StepDV) (int32_t) * it2;
     }
     stroke[key] = (int32_t) 0;
     return STATUS_BUSY_MOVING;
@@ -134,7 +190,12 @@ Status JsonController::initializeStroke(JsonCommand &jcmd, JsonObject& stroke) {
     Status status = STATUS_BUSY_MOVING;
     int16_t slen[4] = {0, 0, 0, 0};
     bool us_ok = false;
-	machine.stroke.clear();
+    Stroke *pStroke = machine.strokeBuffer();
+    if (pStroke == NULL) {
+        return STATUS_STROKE_QUEUE_FULL;
+    }
+    Stroke &strokeBuf = *pStroke;
+	strokeBuf.clear();
     for (JsonObject::iterator it = stroke.begin(); it != stroke.end(); ++it) {
         if (strcmp("us", it->key) == 0) {
             int32_t planMicros;
@@ -143,7 +204,7 @@ Status JsonController::initializeStroke(JsonCommand &jcmd, JsonObject& stroke) {
                 return jcmd.setError(status, it->key);
             }
             float seconds = (float) planMicros / 1000000.0;
-            machine.stroke.setTimePlanned(seconds);
+            strokeBuf.setTimePlanned(seconds);
             us_ok = true;
         } else if (strcmp("dp", it->key) == 0) {
             JsonArray &jarr = stroke[it->key];
@@ -154,10 +215,27 @@ Status JsonController::initializeStroke(JsonCommand &jcmd, JsonObject& stroke) {
                 return jcmd.setError(STATUS_JSON_ARRAY_LEN, it->key);
             }
             for (MotorIndex i = 0; i < 4 && jarr[i].success(); i++) {
-                machine.stroke.dEndPos.value[i] = jarr[i];
+                strokeBuf.dEndPos.value[i] = jarr[i];
             }
         } else if (strcmp("sc", it->key) == 0) {
-            status = processField<StepCoord, int32_t>(stroke, it->key, machine.stroke.scale);
+            status = processField<StepCoord, int32_t>(stroke, it->key, strokeBuf.scale);
+            if (status != STATUS_OK) {
+                return jcmd.setError(status, it->key);
+            }
+        } else if (strcmp("dda", it->key) == 0) {
+#ifdef STEP_ENGINE
+            status = processField<bool, bool>(stroke, it->key, strokeBuf.dda);
+#else
+            status = STATUS_STROKE_DDA; // slices would be emitted in bursts
+#endif
+            if (status != STATUS_OK) {
+                return jcmd.setError(status, it->key);
+            }
+        } else if (strcmp("so", it->key) == 0) {
+            status = processField<uint8_t, int32_t>(stroke, it->key, strokeBuf.order);
+            if (status == STATUS_OK && (strokeBuf.order < 1 || 2 < strokeBuf.order)) {
+                status = STATUS_FIELD_RANGE_ERROR;
+            }
             if (status != STATUS_OK) {
                 return jcmd.setError(status, it->key);
             }
@@ -166,10 +244,10 @@ Status JsonController::initializeStroke(JsonCommand &jcmd, JsonObject& stroke) {
             if (iMotor == INDEX_NONE) {
                 return jcmd.setError(STATUS_NO_MOTOR, it->key);
             }
-            status = initializeStrokeArray(jcmd, stroke, it->key, iMotor, slen[iMotor]);
+            status = initializeStrokeArray(jcmd, strokeBuf, stroke, it->key, iMotor, slen[iMotor]);
         }
     }
-    if (status != STATUS_BUSY_MOVING) {
+    if (status < 0) {
         return status;
     }
     if (!us_ok) {
@@ -184,26 +262,79 @@ Status JsonController::initializeStroke(JsonCommand &jcmd, JsonObject& stroke) {
     if (slen[0] && slen[3] && slen[0] != slen[3]) {
         return STATUS_S1S4LEN_ERROR;
     }
-    machine.stroke.length = slen[0] ? slen[0] : (slen[1] ? slen[1] : (slen[2] ? slen[2] : slen[3]));
-    if (machine.stroke.length == 0) {
+    strokeBuf.length = slen[0] ? slen[0] : (slen[1] ? slen[1] : (slen[2] ? slen[2] : slen[3]));
+    if (strokeBuf.length == 0) {
         return STATUS_STROKE_NULL_ERROR;
     }
-    machine.stroke.start(ticks());
+    Ticks tNow = ticks();
+    strokeBuf.setFeedRate(tNow, machine.getFeedRate());
+    strokeBuf.start(machine.strokeStartTicks(tNow)); // dp overrides interpolated end
+    status = machine.checkStrokeTravel(strokeBuf);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    machine.queueStroke();
+    return STATUS_BUSY_MOVING;
+}
+
+/**
+ * Traverse the current stroke and release it when done. The stroke
+ * position is reported in the given stroke response, if any.
+ */
+Status JsonController::traverseStroke(JsonObject *pStroke) {
+    Status status = STATUS_BUSY_MOVING;
+    if (machine.stroke().curSeg < machine.stroke().length) {
+        status = machine.stroke().traverse(ticks(), machine.strokeStepper());
+#ifdef STEP_ENGINE
+        if (status == STATUS_OK && !machine.stepEngine.isIdle()) {
+            status = STATUS_BUSY_MOVING; // queued pulses are still being emitted
+        }
+#endif
+        if (pStroke) {
+            reportStroke(*pStroke, machine.stroke().position());
+        }
+    }
+    if (machine.stroke().curSeg >= machine.stroke().length) {
+        status = STATUS_OK;
+    }
+    if (status == STATUS_OK) {
+        machine.dequeueStroke();
+    } else if (status < 0) {
+        machine.clearStrokes();
+    }
     return status;
 }
 
-Status JsonController::traverseStroke(JsonCommand &jcmd, JsonObject &stroke) {
-    Status status =  machine.stroke.traverse(ticks(), machine);
+#ifdef STROKE_GENERATOR
+/**
+ * Traverse the line of the machine line generator, which evaluates its
+ * segments on demand. The line position is reported in the given line
+ * response, if any.
+ */
+Status JsonController::traverseGenerator(JsonObject *pLine) {
+    Status status = machine.lineGenerator.traverse(ticks(), machine.strokeStepper());
+#ifdef STEP_ENGINE
+    if (status == STATUS_OK && !machine.stepEngine.isIdle()) {
+        status = STATUS_BUSY_MOVING; // queued pulses are still being emitted
+    }
+#endif
+    if (pLine) {
+        reportStroke(*pLine, machine.lineGenerator.position());
+    }
+    return status;
+}
+#endif
 
-    Quad<StepCoord> &pos = machine.stroke.position();
+/**
+ * Set the motor fields of a stroke response to the given offsets
+ */
+void JsonController::reportStroke(JsonObject &stroke, Quad<StepCoord> &pos) {
     for (JsonObject::iterator it = stroke.begin(); it != stroke.end(); ++it) {
         MotorIndex iMotor = machine.motorOfName(it->key + (strlen(it->key) - 1));
         if (iMotor != INDEX_NONE) {
             stroke[it->key] = pos.value[iMotor];
         }
     }
-
-    return status;
 }
 
 Status JsonController::processStroke(JsonCommand &jcmd, JsonObject& jobj, const char* key) {
@@ -216,12 +347,7 @@ Status JsonController::processStroke(JsonCommand &jcmd, JsonObject& jobj, const
     if (status == STATUS_BUSY_PARSED) {
         status = initializeStroke(jcmd, stroke);
     } else if (status == STATUS_BUSY_MOVING) {
-        if (machine.stroke.curSeg < machine.stroke.length) {
-            status = traverseStroke(jcmd, stroke);
-        }
-        if (machine.stroke.curSeg >= machine.stroke.length) {
-            status = STATUS_OK;
-        }
+        status = traverseStroke(&stroke);
     }
     return status;
 }
@@ -378,20 +504,25 @@ typedef class PHSelfTest {
         int32_t vMax;
 		PH5TYPE tvMax;
 		int16_t nSegs;
+		bool lazy;
 		Machine &machine;
 
 	private:
 		Status execute(JsonCommand& jcmd, JsonObject& jobj);
+		Status executeLazy(JsonCommand& jcmd, JsonObject& jobj);
 
     public:
         PHSelfTest(Machine& machine)
-            : nSamples(0), pulses(6400), vMax(12800), tvMax(0.7), nSegs(0), machine(machine)
+            : nSamples(0), pulses(6400), vMax(12800), tvMax(0.7), nSegs(0), lazy(false), machine(machine)
         {}
 
         Status process(JsonCommand& jcmd, JsonObject& jobj, const char* key);
 } PHSelfTest;
 
 Status PHSelfTest::execute(JsonCommand &jcmd, JsonObject& jobj) {
+	if (lazy) {
+		return executeLazy(jcmd, jobj);
+	}
 	int16_t minSegs = nSegs ? nSegs : 0; //max(10, min(SEGMENT_COUNT-1,abs(pulses)/100));
 	int16_t maxSegs = nSegs ? nSegs : 0; // SEGMENT_COUNT-1;
 	if (maxSegs >= SEGMENT_COUNT) {
@@ -407,7 +538,7 @@ Status PHSelfTest::execute(JsonCommand &jcmd, JsonObject& jobj) {
 			machine.getMotorAxis(2).isEnabled() ? -pulses : 0,
 			machine.getMotorAxis(3).isEnabled() ? -pulses : 0));
 	}
-    Status status = sb.buildLine(machine.stroke, Quad<StepCoord>(
+    Status status = sb.buildLine(machine.stroke(), Quad<StepCoord>(
 		machine.getMotorAxis(0).isEnabled() ? pulses : 0,
 		machine.getMotorAxis(1).isEnabled() ? pulses : 0,
 		machine.getMotorAxis(2).isEnabled() ? pulses : 0,
@@ -416,7 +547,7 @@ Status PHSelfTest::execute(JsonCommand &jcmd, JsonObject& jobj) {
 		return status;
 	}
 	Ticks tStart = ticks();
-	status = machine.stroke.start(tStart);
+	status = machine.stroke().start(tStart);
 	switch (status) {
 		case STATUS_OK:
 			break;
@@ -431,13 +562,13 @@ Status PHSelfTest::execute(JsonCommand &jcmd, JsonObject& jobj) {
 #endif
 	do {
 		nSamples++;
-		status =  machine.stroke.traverse(ticks(), machine);
+		status =  machine.stroke().traverse(ticks(), machine);
 #ifdef TEST
 		if (nSamples % 500 == 0) {
 			cout << "PHSelfTest:execute()" 
 				<< " t:"
-				<< (threadClock.ticks - machine.stroke.tStart)/
-					(float) machine.stroke.get_dtTotal()
+				<< (threadClock.ticks - machine.stroke().tStart)/
+					(float) machine.stroke().get_dtTotal()
 				<< " pos:"
 				<< machine.getMotorPosition().toString() << endl;
 		}
@@ -453,16 +584,64 @@ Status PHSelfTest::execute(JsonCommand &jcmd, JsonObject& jobj) {
 	Ticks tElapsed = ticks() - tStart;
 
 	float te = tElapsed / (float) TICKS_PER_SECOND;
-	float tp = machine.stroke.getTimePlanned();
+	float tp = machine.stroke().getTimePlanned();
 	jobj["lp"] = nSamples;
-	jobj["pp"].set(machine.stroke.vPeak * (machine.stroke.length / te), 1);
-	jobj["sg"] = machine.stroke.length;
+	jobj["pp"].set(machine.stroke().vPeak * (machine.stroke().length / te), 1);
+	jobj["sg"] = machine.stroke().length;
 	jobj["te"].set(te,3);
 	jobj["tp"].set(tp,3);
 
 	return status;
 }
 
+/**
+ * Same as execute() but segments are generated during traversal
+ */
+Status PHSelfTest::executeLazy(JsonCommand &jcmd, JsonObject& jobj) {
+    StrokeBuilder sb(vMax, tvMax, nSegs, nSegs);
+	if (pulses >= 0) {
+		machine.setMotorPosition(Quad<StepCoord>());
+	} else {
+		machine.setMotorPosition(Quad<StepCoord>(
+			machine.getMotorAxis(0).isEnabled() ? -pulses : 0,
+			machine.getMotorAxis(1).isEnabled() ? -pulses : 0,
+			machine.getMotorAxis(2).isEnabled() ? -pulses : 0,
+			machine.getMotorAxis(3).isEnabled() ? -pulses : 0));
+	}
+	StrokeGenerator sg(sb, Quad<StepCoord>(
+		machine.getMotorAxis(0).isEnabled() ? pulses : 0,
+		machine.getMotorAxis(1).isEnabled() ? pulses : 0,
+		machine.getMotorAxis(2).isEnabled() ? pulses : 0,
+		machine.getMotorAxis(3).isEnabled() ? pulses : 0));
+	Ticks tStart = ticks();
+	Status status = sg.start(tStart);
+	switch (status) {
+		case STATUS_OK:
+			break;
+		case STATUS_STROKE_TIME:
+			return jcmd.setError(status, "tv");
+		default:
+			return status;
+	}
+	do {
+		nSamples++;
+		status = sg.traverse(ticks(), machine);
+	} while (status == STATUS_BUSY_MOVING);
+	if (status == STATUS_OK) {
+		status = STATUS_BUSY_MOVING; // repeat indefinitely
+	}
+	Ticks tElapsed = ticks() - tStart;
+
+	float te = tElapsed / (float) TICKS_PER_SECOND;
+	jobj["lp"] = nSamples;
+	jobj["pp"].set(sg.vPeak * (sg.length / te), 1);
+	jobj["sg"] = sg.length;
+	jobj["te"].set(te,3);
+	jobj["tp"].set(sg.getTimePlanned(),3);
+
+	return status;
+}
+
 Status PHSelfTest::process(JsonCommand& jcmd, JsonObject& jobj, const char* key) {
     Status status = STATUS_OK;
 	const char *s;
@@ -499,6 +678,8 @@ Status PHSelfTest::process(JsonCommand& jcmd, JsonObject& jobj, const char* key)
 		}
     } else if (strcmp("lp", key) == 0) {
 		// output variable
+    } else if (strcmp("lz", key) == 0) {
+        status = processField<bool, bool>(jobj, key, lazy);
     } else if (strcmp("mv", key) == 0) {
         status = processField<int32_t, int32_t>(jobj, key, vMax);
     } else if (strcmp("pp", key) == 0) {
@@ -589,9 +770,15 @@ Status JsonController::processSys(JsonCommand& jcmd, JsonObject& jobj, const cha
         const char *s;
         if ((s = jobj[key]) && *s == 0) {
             JsonObject& node = jobj.createNestedObject(key);
+#ifdef STROKE_CACHE_SIZE
+            node["ch"] = "";
+            node["cm"] = "";
+#endif
+            node["fo"] = "";
             node["fr"] = "";
             node["jp"] = "";
             node["lh"] = "";
+            node["li"] = "";
             node["lp"] = "";
             node["pc"] = "";
             node["tc"] = "";
@@ -606,6 +793,23 @@ Status JsonController::processSys(JsonCommand& jcmd, JsonObject& jobj, const cha
                 }
             }
         }
+#ifdef STROKE_CACHE_SIZE
+    } else if (strcmp("ch", key) == 0 || strcmp("sysch", key) == 0) {
+        status = processField<int32_t, int32_t>(jobj, key, machine.strokeCache.hits);
+    } else if (strcmp("cm", key) == 0 || strcmp("syscm", key) == 0) {
+        status = processField<int32_t, int32_t>(jobj, key, machine.strokeCache.misses);
+#endif
+    } else if (strcmp("fo", key) == 0 || strcmp("sysfo", key) == 0) {
+        int16_t fo = machine.getFeedRate();
+        const char *s;
+        bool query = (s = jobj.at(key)) && *s == 0;
+        status = processField<int16_t, int32_t>(jobj, key, fo);
+        if (!query && status == STATUS_OK) {
+            status = machine.setFeedRate(fo, ticks());
+            if (status != STATUS_OK) {
+                return jcmd.setError(status, key);
+            }
+        }
     } else if (strcmp("fr", key) == 0 || strcmp("sysfr", key) == 0) {
         jobj[key] = freeRam();
     } else if (strcmp("jp", key) == 0 || strcmp("sysjp", key) == 0) {
@@ -621,6 +825,8 @@ Status JsonController::processSys(JsonCommand& jcmd, JsonObject& jobj, const cha
         }
     } else if (strcmp("lh", key) == 0 || strcmp("syslh", key) == 0) {
         status = processField<bool, bool>(jobj, key, machine.invertLim);
+    } else if (strcmp("li", key) == 0 || strcmp("sysli", key) == 0) {
+        status = processField<uint8_t, int32_t>(jobj, key, machine.limitPoll);
     } else if (strcmp("lp", key) == 0 || strcmp("syslp", key) == 0) {
         status = processField<int32_t, int32_t>(jobj, key, nLoops);
     } else if (strcmp("tc", key) == 0 || strcmp("systc", key) == 0) {
@@ -633,6 +839,141 @@ Status JsonController::processSys(JsonCommand& jcmd, JsonObject& jobj, const cha
     return status;
 }
 
+/**
+ * Initialize a PH5 line to the given motor offsets, or replay the cached
+ * line with the given id. Lines are built through the machine stroke cache
+ * if STROKE_CACHE_SIZE is defined. With "od":true, the line is planned by
+ * the machine line generator, whose segments are evaluated on demand
+ * during traversal so that the line is not limited by SEGMENT_COUNT.
+ */
+Status JsonController::initializeLine(JsonCommand &jcmd, JsonObject& line) {
+    Status status = STATUS_OK;
+    Stroke *pStroke = machine.strokeBuffer();
+    if (pStroke == NULL) {
+        return STATUS_STROKE_QUEUE_FULL;
+    }
+    Stroke &strokeBuf = *pStroke;
+    StrokeBuilder sb;
+    machine.setStrokeLimits(sb);
+    Quad<StepCoord> relPos;
+#ifdef STROKE_CACHE_SIZE
+    int16_t id = -1;
+    bool id_ok = false;
+#endif
+#ifdef STROKE_GENERATOR
+    bool od = false;
+#endif
+    for (JsonObject::iterator it = line.begin(); it != line.end(); ++it) {
+        if (strcmp("id", it->key) == 0) {
+#ifdef STROKE_CACHE_SIZE
+            status = processField<int16_t, int32_t>(line, it->key, id);
+            if (status == STATUS_OK && (id < -1 || STROKE_CACHE_SIZE <= id)) {
+                status = STATUS_FIELD_RANGE_ERROR;
+            }
+            id_ok = true;
+#else
+            status = STATUS_STROKE_CACHE_ID;
+#endif
+        } else if (strcmp("od", it->key) == 0) {
+#ifdef STROKE_GENERATOR
+            status = processField<bool, bool>(line, it->key, od);
+#else
+            status = STATUS_STROKE_GENERATOR;
+#endif
+        } else if (strcmp("mv", it->key) == 0) {
+            status = processField<int32_t, int32_t>(line, it->key, sb.vMax);
+        } else if (strcmp("tv", it->key) == 0) {
+            status = processField<float, float>(line, it->key, sb.vMaxSeconds);
+        } else if (strcmp("sg", it->key) == 0) {
+            int16_t segs = 0;
+            status = processField<int16_t, int32_t>(line, it->key, segs);
+            if (segs < 0 || SEGMENT_COUNT <= segs) {
+                status = STATUS_STROKE_MAXLEN;
+            }
+            sb.minSegments = sb.maxSegments = segs;
+        } else if (strcmp("md", it->key) == 0) {
+            status = processField<StepCoord, int32_t>(line, it->key, sb.maxDeviation);
+            if (sb.maxDeviation < 0) {
+                status = STATUS_FIELD_RANGE_ERROR;
+            }
+        } else {
+            MotorIndex iMotor = machine.motorOfName(it->key);
+            if (iMotor == INDEX_NONE) {
+                return jcmd.setError(STATUS_NO_MOTOR, it->key);
+            }
+            status = processField<StepCoord, int32_t>(line, it->key, relPos.value[iMotor]);
+        }
+        if (status != STATUS_OK) {
+            return jcmd.setError(status, it->key);
+        }
+    }
+#ifdef STROKE_GENERATOR
+    if (od) {
+#ifdef STROKE_CACHE_SIZE
+        if (id_ok) {
+            return jcmd.setError(STATUS_STROKE_CACHE_ID, "id"); // generated lines are not cached
+        }
+#endif
+        if (machine.getStrokeCount()) {
+            return STATUS_STROKE_QUEUE_FULL;
+        }
+        Ticks tNow = ticks();
+        machine.lineGenerator.plan(sb, relPos);
+        machine.lineGenerator.setFeedRate(tNow, machine.getFeedRate());
+        status = machine.lineGenerator.start(tNow);
+        return status == STATUS_OK ? STATUS_BUSY_MOVING : status;
+    }
+#endif
+#ifdef STROKE_CACHE_SIZE
+    int8_t cacheId = (int8_t) id;
+    if (id >= 0) {
+        status = machine.strokeCache.load(cacheId, strokeBuf);
+    } else {
+        status = machine.strokeCache.buildLine(sb, strokeBuf, relPos, cacheId);
+    }
+    if (status != STATUS_OK) {
+        return status;
+    }
+    if (id_ok) {
+        line["id"] = cacheId;
+    }
+#else
+    status = sb.buildLine(strokeBuf, relPos);
+    if (status != STATUS_OK) {
+        return status;
+    }
+#endif
+    Ticks tNow = ticks();
+    strokeBuf.setFeedRate(tNow, machine.getFeedRate());
+    status = strokeBuf.start(machine.strokeStartTicks(tNow));
+    if (status != STATUS_OK) {
+        return status;
+    }
+    status = machine.checkStrokeTravel(strokeBuf);
+    if (status != STATUS_OK) {
+        return status;
+    }
+    machine.queueStroke();
+    return STATUS_BUSY_MOVING;
+}
+
+Status JsonController::processLine(JsonCommand &jcmd, JsonObject& jobj, const char* key) {
+    JsonObject &line = jobj[key];
+    if (!line.success()) {
+        return STATUS_JSON_STROKE_ERROR;
+    }
+    Status status = jcmd.getStatus();
+    if (status == STATUS_BUSY_PARSED) {
+        return initializeLine(jcmd, line);
+    }
+#ifdef STROKE_GENERATOR
+    if (status == STATUS_BUSY_MOVING && (bool) line["od"]) {
+        return traverseGenerator(&line);
+    }
+#endif
+    return processStroke(jcmd, jobj, key); // traverse like dvs
+}
+
 Status JsonController::initializeHome(JsonCommand& jcmd, JsonObject& jobj, const char* key) {
     Status status = STATUS_OK;
     if (strcmp("ho", key) == 0) {
@@ -668,7 +1009,7 @@ Status JsonController::processHome(JsonCommand& jcmd, JsonObject& jobj, const ch
     if (status == STATUS_BUSY_PARSED) {
         status = initializeHome(jcmd, jobj, key);
     } else if (status == STATUS_BUSY_MOVING) {
-        status = machine.home();
+        status = machine.home(ticks());
     } else {
         return jcmd.setError(STATUS_STATE, key);
     }
@@ -706,7 +1047,7 @@ Status JsonController::processMove(JsonCommand& jcmd, JsonObject& jobj, const ch
     if (status == STATUS_BUSY_PARSED) {
         status = initializeMove(jcmd, jobj, key);
     } else if (status == STATUS_BUSY_MOVING) {
-        status = machine.moveTo(jcmd.move, jcmd.stepRate);
+        status = machine.moveTo(jcmd.move, jcmd.stepRate, ticks());
     } else {
         return jcmd.setError(STATUS_STATE, key);
     }
@@ -775,11 +1116,138 @@ Status JsonController::processDisplay(JsonCommand& jcmd, JsonObject& jobj, const
 }
 
 Status JsonController::cancel(JsonCommand& jcmd, Status cause) {
+    machine.clearStrokes();
+    machine.clearMove();
+    machine.clearHome();
     jcmd.setStatus(cause);
     sendResponse(jcmd);
     return STATUS_WAIT_CANCELLED;
 }
 
+/**
+ * Return true if the command is a lone dvs stroke or lin line that can be
+ * queued while the current stroke traverses. Generated lin lines ("od")
+ * are not queued.
+ */
+bool JsonController::isStroke(JsonCommand &jcmd) {
+    JsonObject& root = jcmd.requestRoot();
+    JsonObject::iterator it = root.begin();
+    if (it == root.end() || (strcmp("dvs", it->key) != 0 && strcmp("lin", it->key) != 0)) {
+        return false;
+    }
+    if (isGeneratedLine(jcmd)) {
+        return false;
+    }
+    return ++it == root.end();
+}
+
+/**
+ * Return true if the command is a lone lin "od":true line, which is
+ * traversed by the line generator instead of a stroke buffer
+ */
+bool JsonController::isGeneratedLine(JsonCommand &jcmd) {
+#ifdef STROKE_GENERATOR
+    JsonObject& root = jcmd.requestRoot();
+    JsonObject::iterator it = root.begin();
+    if (it == root.end() || strcmp("lin", it->key) != 0) {
+        return false;
+    }
+    JsonObject& line = root[it->key];
+    if (!line.success() || !(bool) line["od"]) {
+        return false;
+    }
+    return ++it == root.end();
+#else
+    return false;
+#endif
+}
+
+/**
+ * Return true if the command only sets the feed rate override,
+ * which applies immediately to the current stroke
+ */
+bool JsonController::isFeedRate(JsonCommand &jcmd) {
+    JsonObject& root = jcmd.requestRoot();
+    JsonObject::iterator it = root.begin();
+    if (it == root.end()) {
+        return false;
+    }
+    if (strcmp("sys", it->key) == 0) {
+        JsonObject& kidObj = root[it->key];
+        if (!kidObj.success()) {
+            return false;
+        }
+        JsonObject::iterator itKid = kidObj.begin();
+        if (itKid == kidObj.end() || strcmp("fo", itKid->key) != 0 || ++itKid != kidObj.end()) {
+            return false;
+        }
+    } else if (strcmp("sysfo", it->key) != 0) {
+        return false;
+    }
+    return ++it == root.end();
+}
+
+/**
+ * Render the response of the current dvs or lin command with the end
+ * position of its stroke, so that the command buffer can read the next
+ * command while the stroke traverses. Return false if the response
+ * does not fit.
+ */
+bool JsonController::parkStroke(JsonCommand &jcmd) {
+    if (machine.jsonPrettyPrint) {
+        return false;
+    }
+    JsonObject& root = jcmd.requestRoot();
+    JsonObject& stroke = root[root.begin()->key];
+    if (!stroke.success()) {
+        return false;
+    }
+#ifdef STROKE_GENERATOR
+    parkedLine = isGeneratedLine(jcmd);
+    if (parkedLine) {
+        reportStroke(stroke, machine.lineGenerator.dEndPos);
+    } else {
+        reportStroke(stroke, machine.stroke().dEndPos);
+    }
+#else
+    reportStroke(stroke, machine.stroke().dEndPos);
+#endif
+    return root.printTo(parked, sizeof(parked)) < sizeof(parked) - 1;
+}
+
+/**
+ * Traverse the stroke or generated line of the parked command and send
+ * its response when done
+ */
+Status JsonController::processParked() {
+#ifdef STROKE_GENERATOR
+    Status status = parkedLine ? traverseGenerator(NULL) : traverseStroke(NULL);
+#else
+    Status status = traverseStroke(NULL);
+#endif
+    if (!isProcessing(status)) {
+        sendParked(status);
+    }
+    lastProcessed = threadClock.ticks;
+    return status;
+}
+
+Status JsonController::cancelParked(Status cause) {
+    machine.clearStrokes();
+    machine.clearMove();
+    machine.clearHome();
+    sendParked(cause);
+    return STATUS_WAIT_CANCELLED;
+}
+
+void JsonController::sendParked(Status status) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "{\"s\":%d,\"r\":", status);
+    Serial.print(buf);
+    Serial.print(parked);
+    Serial.println("}");
+}
+
 void JsonController::sendResponse(JsonCommand &jcmd) {
     if (machine.jsonPrettyPrint) {
         jcmd.response().prettyPrintTo(Serial);
@@ -799,6 +1267,8 @@ Status JsonController::process(JsonCommand& jcmd) {
     for (JsonObject::iterator it = root.begin(); status >= 0 && it != root.end(); ++it) {
         if (strcmp("dvs", it->key) == 0) {
             status = processStroke(jcmd, root, it->key);
+        } else if (strcmp("lin", it->key) == 0) {
+            status = processLine(jcmd, root, it->key);
         } else if (strcmp("mov", it->key) == 0) {
             status = processMove(jcmd, root, it->key);
         } else if (strncmp("ho", it->key, 2) == 0) {
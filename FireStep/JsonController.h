@@ -10,14 +10,22 @@
 
 namespace firestep {
 
+#define MAX_PARKED 100 /* response of a stroke command parked by parkStroke() */
+
 typedef class JsonController {
     private:
         Ticks lastProcessed;
+        char parked[MAX_PARKED];
+#ifdef STROKE_GENERATOR
+        bool parkedLine;	// parked command traverses the line generator
+#endif
     private:
-        Status initializeStrokeArray(JsonCommand &jcmd, JsonObject& stroke,
+        Status initializeStrokeArray(JsonCommand &jcmd, Stroke &strokeBuf, JsonObject& stroke,
                                      const char *key, MotorIndex iMotor, int16_t &slen);
         Status processRawSteps(Quad<StepCoord> &steps);
+        void reportStroke(JsonObject &stroke, Quad<StepCoord> &pos);
         void sendResponse(JsonCommand& jcmd);
+        void sendParked(Status status);
     protected:
         Machine &machine;
         Status initializeStroke(JsonCommand &jcmd, JsonObject& stroke);
@@ -31,9 +39,14 @@ typedef class JsonController {
         Status processPin(JsonObject& jobj, const char *key, PinType &pin, int16_t mode, int16_t value = LOW);
         Status processStepperPosition(JsonCommand &jcmd, JsonObject& jobj, const char* key);
         Status processStroke(JsonCommand &jcmd, JsonObject& jobj, const char* key);
+        Status initializeLine(JsonCommand &jcmd, JsonObject& line);
+        Status processLine(JsonCommand &jcmd, JsonObject& jobj, const char* key);
         Status processSys(JsonCommand& jcmd, JsonObject& jobj, const char* key);
         Status processTest(JsonCommand& jcmd, JsonObject& jobj, const char* key);
-        Status traverseStroke(JsonCommand &jcmd, JsonObject &stroke);
+        Status traverseStroke(JsonObject *pStroke);
+#ifdef STROKE_GENERATOR
+        Status traverseGenerator(JsonObject *pLine);
+#endif
 
     public:
         JsonController(Machine& machine);
@@ -41,6 +54,19 @@ typedef class JsonController {
         Status setup();
         Status process(JsonCommand& jcmd);
         Status cancel(JsonCommand &jcmd, Status cause);
+        bool parkStroke(JsonCommand &jcmd);
+        Status processParked();
+        Status cancelParked(Status cause);
+        bool isStroke(JsonCommand &jcmd);
+        bool isGeneratedLine(JsonCommand &jcmd);
+        bool isFeedRate(JsonCommand &jcmd);
+        bool isParkedLine() {
+#ifdef STROKE_GENERATOR
+            return parkedLine;
+#else
+            return false;
+#endif
+        }
         Ticks getLastProcessed() {
             return lastProcessed;
         }
@@ -98,12 +98,38 @@ inline void pulseFast(uint8_t pin) {
 
 	SREG = oldSREG;
 }
+
+/**
+ * Pulse all the pins of the given port output register
+ * selected by mask with a single write for each edge.
+ */
+inline void pulsePort(volatile uint8_t *out, uint8_t mask) {
+	uint8_t oldSREG = SREG;
+	cli();
+	*out |= mask;
+	STEPPER_PULSE_DELAY;
+	*out &= ~mask;
+	SREG = oldSREG;
+}
 #else
 inline void pulseFast(uint8_t pin) {
 	digitalWrite(pin, HIGH);
 	// Arduino digital I/O is so slow there is no need for delay
 	digitalWrite(pin, LOW);
 }
+
+inline void pulsePort(volatile uint8_t *out, uint8_t mask) {
+	for (uint8_t bit = 0; bit < 8; bit++) {
+		if (mask & (1 << bit)) {
+			digitalWrite(portBitPin(out, bit), HIGH);
+		}
+	}
+	for (uint8_t bit = 0; bit < 8; bit++) {
+		if (mask & (1 << bit)) {
+			digitalWrite(portBitPin(out, bit), LOW);
+		}
+	}
+}
 #endif
 
 
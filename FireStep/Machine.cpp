@@ -15,7 +15,7 @@ using namespace firestep;
 template class Quad<int16_t>;
 template class Quad<int32_t>;
 
-#define PULSEAXIS_MICS 6 /* microseconds for a single pulseAxis() invocation */
+#define MOVE_RAMP 4 /* moveTo() accelerates and decelerates for 1/MOVE_RAMP of the move each */
 
 #ifdef TEST
 int32_t firestep::delayMicsTotal = 0;
@@ -32,16 +32,22 @@ Status Axis::enable(bool active) {
 }
 
 Machine::Machine()
-    : invertLim(false), pDisplay(&nullDisplay), jsonPrettyPrint(false) {
+    : invertLim(false), limitPoll(1), pDisplay(&nullDisplay), jsonPrettyPrint(false) {
     pinEnableHigh = false;
-    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-        setAxisIndex((MotorIndex)i, (AxisIndex)i);
-    }
-    setPinConfig(PC2_RAMPS_1_4);
-
+    limitPollCount = 0;
+    moving = false;
+    tHome = 0;
+    iStroke = 0;
+    nStrokes = 0;
+    feedRate = 100;
+#ifdef STEP_ENGINE
+    stepEngine.setup(*this, stepPorts);
+#endif
     for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
         motor[i] = i;
+        motorAxis[i] = &axis[i];
     }
+    setPinConfig(PC2_RAMPS_1_4);
 }
 
 Status Machine::setPinConfig(PinConfig pc) {
@@ -105,104 +111,273 @@ Status Machine::setAxisIndex(MotorIndex iMotor, AxisIndex iAxis) {
     }
     motor[iMotor] = iAxis;
     motorAxis[iMotor] = &axis[iAxis];
+    updateStepPorts();
     return STATUS_OK;
 }
 
-Status Machine::home() {
-    int16_t searchDelay = 0;
-    for (MotorIndex i = 0; i < QUAD_ELEMENTS; i++) {
+/**
+ * Home the homing axes in parallel without blocking. Each axis seeks its
+ * minimum limit switch fast, backs off latchBackoff pulses, latches the
+ * switch slowly and backs off again to its home position. Each axis pulses
+ * at its own rate for the time elapsed since the previous invocation.
+ */
+Status Machine::home(Ticks tNow) {
+    bool homing = false;
+    bool starting = false;
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
         Axis &a(*motorAxis[i]);
-        if (a.homing) {
+        if (a.homing && a.homePhase == HOME_IDLE) {
             if (!a.enabled && a.pinMin != NOPIN) {
                 return STATUS_AXIS_DISABLED;
             }
             a.position = a.home;
-            searchDelay = max(searchDelay, a.searchDelay);
+            if (a.enabled) {
+                a.homePhase = HOME_SEEK;
+                a.homeMics = 0;
+                starting = true;
+            } else {
+                a.homing = false;
+            }
         }
+        homing = homing || a.homing;
     }
+    if (!homing) {
+        return STATUS_OK;
+    }
+    if (starting) {
+        tHome = tNow;
+    }
+    int32_t mics = (tNow - tHome) * TICK_MICROSECONDS;
+    tHome = tNow;
 
-    if (stepHome(32, searchDelay) > 0) {
-        return STATUS_BUSY_MOVING;
+    uint8_t pulses[MOTOR_COUNT];
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        Axis &a(*motorAxis[i]);
+        pulses[i] = 0;
+        if (a.homing) {
+            DelayMics us = a.homeDelay();
+            a.homeMics += mics;
+            if (a.homeMics / us > HOME_PULSES) {
+                pulses[i] = HOME_PULSES;
+                a.homeMics = 0;
+            } else {
+                pulses[i] = a.homeMics / us;
+                a.homeMics -= pulses[i] * (int32_t) us;
+            }
+        }
+    }
+    for (bool hasPulses = true; hasPulses;) {
+        hasPulses = false;
+        for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+            if (pulses[i]) {
+                pulses[i] = homePulse(*motorAxis[i]) ? pulses[i] - 1 : 0;
+                hasPulses = true;
+            }
+        }
     }
 
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        if (motorAxis[i]->homing) {
+            return STATUS_BUSY_MOVING;
+        }
+    }
     return STATUS_OK;
 }
 
-Status Machine::moveTo(Quad<StepCoord> destination, float seconds) {
-    int32_t micsLeft = seconds * 1000000;
-    Quad<StepCoord> delta(destination - getMotorPosition());
-    Quad<StepCoord> pos;
-    int8_t td = 64;
-    float tdSeconds = seconds / (td + 2);
-    float tdEnd = tdSeconds * 2;
-    //cout << "t:" << (tdSeconds*(td-2) + tdEnd*2) << endl;
-    StepCoord maxSteps = 0;
-    for (int8_t tn = 0; tn <= td; tn++) {
-        Quad<StepCoord> segment;
-        for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
-            segment.value[i] = (tn * delta.value[i]) / td - pos.value[i];
+/**
+ * Advance the given homing axis by one pulse of its current phase.
+ * Return false if the phase changed, since the pulse rate may change.
+ */
+bool Machine::homePulse(Axis &a) {
+    uint8_t phase = a.homePhase;
+    switch (phase) {
+    case HOME_SEEK:
+    case HOME_LATCH:
+        a.readAtMin(invertLim);
+        if (!a.atMin) {
+            a.pulse(false);
+            return true;
+        }
+        a.homePhase = phase == HOME_SEEK ? HOME_BACKOFF : HOME_RELEASE;
+        a.homePulses = a.latchBackoff;
+        break;
+    case HOME_BACKOFF:
+    case HOME_RELEASE:
+        a.pulse(true);
+        a.homePulses--;
+        break;
+    }
+    if (a.homePulses <= 0) {
+        a.homePhase = a.homePhase == HOME_BACKOFF ? HOME_LATCH : HOME_IDLE;
+        a.homing = a.homePhase != HOME_IDLE;
+    }
+    if (a.homePhase == phase) {
+        return true;
+    }
+    a.homeMics = 0;
+    return false;
+}
+
+/**
+ * Start a trapezoidal move to the given destination that takes the given
+ * time but is no faster than the axis usDelay pulse rates allow.
+ */
+Status Machine::moveStart(Quad<StepCoord> destination, float seconds, Ticks tNow) {
+    moveFrom = getMotorPosition();
+    moveGoal = destination;
+    tMoveStart = tNow;
+    dtMove = seconds > 0 ? MS_TICKS(seconds * 1000) : 0;
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        StepCoord delta = abs(moveGoal.value[i] - moveFrom.value[i]);
+        if (delta) {
+            if (!motorAxis[i]->enabled) {
+                return STATUS_AXIS_DISABLED;
+            }
+            // peak velocity is MOVE_RAMP/(MOVE_RAMP-1) times the average velocity.
+            // Divide before the ramp factor so that delta*usDelay*MOVE_RAMP cannot overflow.
+            Ticks dtMin = ((int32_t)delta * motorAxis[i]->usDelay / TICK_MICROSECONDS) *
+                          MOVE_RAMP / (MOVE_RAMP - 1);
+            dtMove = max(dtMove, dtMin);
         }
-        float t = (tn == 0 || tn == td) ? tdEnd : tdSeconds;	// start/stop ramp
-        //cout <<  t << " segment:" << segment.toString() << endl;
-        Status status = moveDelta(segment, t);
-        if (status < 0) {
+    }
+    moving = true;
+    return STATUS_OK;
+}
+
+/**
+ * Return the trapezoidal velocity profile fraction of the current move
+ * completed at the given time
+ */
+float Machine::moveFraction(Ticks tNow) {
+    Ticks t = tNow - tMoveStart;
+    if (t >= dtMove) {
+        return 1;
+    }
+    Ticks dtRamp = dtMove / MOVE_RAMP;
+    if (dtRamp == 0) {
+        return t / (float) dtMove;
+    }
+    float den = 2.0 * dtRamp * (dtMove - dtRamp);
+    if (t < dtRamp) {
+        return t * (float) t / den;
+    }
+    Ticks tLeft = dtMove - t;
+    if (tLeft < dtRamp) {
+        return 1 - tLeft * (float) tLeft / den;
+    }
+    return (2.0 * dtRamp * t - dtRamp * (float) dtRamp) / den;
+}
+
+/**
+ * Move towards the destination with a trapezoidal velocity profile
+ * timed by tNow. Each invocation pulses the motors to their planned
+ * position at tNow and returns STATUS_BUSY_MOVING until the move
+ * has taken the planned time and the destination is reached.
+ */
+Status Machine::moveTo(Quad<StepCoord> destination, float seconds, Ticks tNow) {
+    Status status;
+    if (!moving || destination != moveGoal) {
+        status = moveStart(destination, seconds, tNow);
+        if (status != STATUS_OK) {
+            clearMove();
             return status;
         }
-        pos += segment;
     }
+    float f = moveFraction(tNow);
+    Quad<StepCoord> goal;
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        float pos = moveFrom.value[i] + f * (moveGoal.value[i] - moveFrom.value[i]);
+        goal.value[i] = pos < 0 ? pos - 0.5 : pos + 0.5;
+    }
+    status = moveDelta(goal - getMotorPosition(), 0);
+    if (status < 0) {
+        clearMove();
+        return status;
+    }
+    if (tNow - tMoveStart < dtMove) {
+        return STATUS_BUSY_MOVING;
+    }
+    clearMove();
     return STATUS_OK;
 }
 
+/**
+ * Pulse the motors by the given offsets along a straight line with a
+ * multi-axis DDA over the largest offset, spacing steps by the largest
+ * usDelay of the moving axes. Motors that share a step pin port are
+ * pulsed together. The move takes at least the given time.
+ */
 Status Machine::moveDelta(Quad<StepCoord> delta, float seconds) {
-    int32_t micsDelay = 0;
     if (delta.isZero()) {
         return STATUS_OK;	// at destination
     }
     int16_t usDelay = 0;
     StepCoord maxDelta = 0;
-    for (MotorIndex i = 0; i < QUAD_ELEMENTS; i++) {
+    MotorIndex active[MOTOR_COUNT];	// moving motors
+    StepCoord dAbs[MOTOR_COUNT];
+    StepCoord err[MOTOR_COUNT];
+    uint8_t nActive = 0;
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
         if (delta.value[i]) {
-            if (!motorAxis[i]->enabled) {
-#ifdef TEST
-				cout << "moveDelta(" << delta.value[i] << ") STATUS_AXIS_DISABLED:" << (int) i << endl;
-#endif
+            Axis &a = *motorAxis[i];
+            if (!a.enabled) {
+                TESTCOUT2("moveDelta(", delta.value[i], ") STATUS_AXIS_DISABLED:", (int) i);
                 return STATUS_AXIS_DISABLED;
             }
-            maxDelta = max(maxDelta, delta.value[i]);
-            usDelay = max(usDelay, motorAxis[i]->usDelay);
+            active[nActive] = i;
+            dAbs[nActive] = abs(delta.value[i]);
+            maxDelta = max(maxDelta, dAbs[nActive]);
+            usDelay = max(usDelay, a.usDelay);
+            nActive++;
         }
     }
-    for (StepCoord iStep = 1; iStep <= maxDelta; iStep++) {
-        int8_t pulses = 0;
-        for (MotorIndex i = 0; i < QUAD_ELEMENTS; i++) {
-            StepCoord step = delta.value[i];
+    for (uint8_t k = 0; k < nActive; k++) {
+        motorAxis[active[k]]->setAdvancing(delta.value[active[k]] > 0);
+        err[k] = maxDelta / 2;
+    }
+    int32_t micsDelay = 0;
+    Status status = STATUS_OK;
+    for (StepCoord iStep = 0; iStep < maxDelta && status == STATUS_OK; iStep++) {
+        uint8_t portMask[MOTOR_COUNT] = {0};
+        for (uint8_t k = 0; k < nActive; k++) {
+            err[k] -= dAbs[k];
+            if (err[k] >= 0) {
+                continue;
+            }
+            err[k] += maxDelta;
+            MotorIndex i = active[k];
             Axis &a = *motorAxis[i];
-            if (step == 0) {
-                // do nothing
-            } else if (-step >= iStep) {
+            if (a.advancing) {
+                if (a.position >= a.travelMax) {
+                    status = STATUS_TRAVEL_MAX;
+                    break;
+                }
+                a.position++;
+            } else {
                 a.readAtMin(invertLim);
                 if (a.atMin) {
-                    return STATUS_LIMIT_MIN;
+                    status = STATUS_LIMIT_MIN;
+                    break;
                 }
                 if (a.position <= a.travelMin) {
-                    return STATUS_TRAVEL_MIN;
+                    status = STATUS_TRAVEL_MIN;
+                    break;
                 }
-                a.pulse(false);
                 a.position--;
-                pulses++;
-            } else if (step >= iStep) {
-                if (a.position >= a.travelMax) {
-                    return STATUS_TRAVEL_MAX;
-                }
-                a.pulse(true);
-                a.position++;
-                pulses++;
             }
+            portMask[stepPorts.motorPort[i]] |= stepPorts.motorMask[i];
         }
-        int16_t us = (usDelay - (pulses - 1) * PULSEAXIS_MICS);
-        delayMics(us);
+        for (uint8_t iPort = 0; iPort < stepPorts.nPorts; iPort++) {
+            if (portMask[iPort]) {
+                pulsePort(stepPorts.port[iPort], portMask[iPort]);
+            }
+        }
+        delayMics(usDelay);
         micsDelay += usDelay;
     }
+    if (status != STATUS_OK) {
+        return status;
+    }
     delayMics(seconds * 1000000 - micsDelay);
     return STATUS_BUSY_MOVING;
 }
@@ -270,6 +445,32 @@ void Machine::setPin(PinType &pinDst, PinType pinSrc, int16_t mode, int16_t valu
             digitalWrite(pinDst, value);
         }
     }
+    updateStepPorts();
+}
+
+/**
+ * Cache the step pin port and bit mask of each axis and group the
+ * motors by step pin port for stepFast()
+ */
+void Machine::updateStepPorts() {
+    for (AxisIndex i = 0; i < AXIS_COUNT; i++) {
+        axis[i].cacheStepPort();
+    }
+    stepPorts.nPorts = 0;
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        Axis &a(*motorAxis[i]);
+        uint8_t iPort = 0;
+        if (a.stepMask) {
+            while (iPort < stepPorts.nPorts && stepPorts.port[iPort] != a.stepPort) {
+                iPort++;
+            }
+            if (iPort == stepPorts.nPorts) {
+                stepPorts.port[stepPorts.nPorts++] = a.stepPort;
+            }
+        }
+        stepPorts.motorPort[i] = iPort;
+        stepPorts.motorMask[i] = a.stepMask;
+    }
 }
 
 void Machine::enable(bool active) {
@@ -349,9 +550,13 @@ Status Machine::step(const Quad<StepDV> &pulse) {
 
 /**
  * Set direction based on the sign of each pulse value
- * and check bounds
+ * and check bounds. Blocks of a travel checked current stroke
+ * only poll the minimum limit switches every limitPoll calls.
  */
 Status Machine::stepDirection(const Quad<StepDV> &pulse) {
+    if (nStrokes && strokeRing[iStroke].travelChecked) {
+        return stepDirectionChecked(pulse);
+    }
     for (uint8_t i = 0; i < QUAD_ELEMENTS; i++) { // Pulse leading edges
         Axis &a(*motorAxis[i]);
         if (pulse.value[i] > 0) {
@@ -390,62 +595,114 @@ Status Machine::stepDirection(const Quad<StepDV> &pulse) {
     return STATUS_OK;
 }
 
+/**
+ * Set direction for a stroke whose travel was checked by checkStrokeTravel()
+ */
+Status Machine::stepDirectionChecked(const Quad<StepDV> &pulse) {
+    bool poll = ++limitPollCount >= limitPoll;
+    if (poll) {
+        limitPollCount = 0;
+    }
+    for (uint8_t i = 0; i < QUAD_ELEMENTS; i++) {
+        Axis &a(*motorAxis[i]);
+        if (pulse.value[i] > 0) {
+			if (!a.advancing) {
+				a.advancing = true;
+				digitalWrite(a.pinDir, a.dirHIGH ? HIGH : LOW);
+			}
+			a.position += pulse.value[i];
+		} else if (pulse.value[i] < 0) {
+            if (poll) {
+                a.readAtMin(invertLim);
+                if (a.atMin) {
+                    return STATUS_LIMIT_MIN;
+                }
+            }
+			if (a.advancing) {
+				a.advancing = false;
+				digitalWrite(a.pinDir, a.dirHIGH ? LOW : HIGH);
+			}
+			a.position += pulse.value[i];
+        }
+    }
+
+    return STATUS_OK;
+}
+
+/**
+ * Check that the given stroke, once started, stays within the travel limits
+ * of enabled axes when it begins at the end of the queued strokes.
+ * Traversal of a checked stroke skips per-block travel checks.
+ */
+Status Machine::checkStrokeTravel(Stroke &stroke) {
+    Quad<StepCoord> pos = getMotorPosition();
+    for (uint8_t iQueue = 0; iQueue < nStrokes; iQueue++) {
+        Stroke &queued = strokeRing[(iStroke + iQueue) % STROKE_BUFFERS];
+        if (&queued != &stroke) {
+            pos += queued.dEndPos;
+            pos -= queued.position();
+        }
+    }
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        Axis &a(*motorAxis[i]);
+        if (stroke.dPosMin.value[i] == 0 && stroke.dPosMax.value[i] == 0) {
+            continue;
+        }
+        if (!a.enabled) {
+            return STATUS_AXIS_DISABLED;
+        }
+        if (pos.value[i] + stroke.dPosMax.value[i] > a.travelMax) {
+            return STATUS_TRAVEL_MAX;
+        }
+        if (pos.value[i] + stroke.dPosMin.value[i] < a.travelMin) {
+            return STATUS_TRAVEL_MIN;
+        }
+    }
+    stroke.travelChecked = true;
+    return STATUS_OK;
+}
 
 /**
  * Send stepper pulses without updating position.
- * This is important for homing, test and calibration
+ * This is important for homing, test and calibration.
+ * Pulses are sent in blocks of up to MACHINE_PULSE_BLOCK pulses per motor
+ * using the same stepDirection() and stepFast() path as stroke traversal.
  * Return STATUS_OK on success
  */
 Status Machine::pulse(Quad<StepCoord> &pulses) {
+    Quad<StepCoord> motorPos = getMotorPosition();
     while (!pulses.isZero()) {
-        Quad<StepCoord> motorPos = getMotorPosition();
-        Quad<StepCoord> pulse(pulses.sgn());
-        motorPos -= pulse;
-        setMotorPosition(motorPos); // permit infinite travel
-
-		Quad<StepDV> steps(
-			(StepDV) pulse.value[0],
-			(StepDV) pulse.value[1],
-			(StepDV) pulse.value[2],
-			(StepDV) pulse.value[3]);
-        Status status = step(steps);
+        Quad<StepDV> block;
+        int32_t usBlock = 0;
+        for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+            StepCoord pv = pulses.value[i];
+            pv = pv > MACHINE_PULSE_BLOCK ? MACHINE_PULSE_BLOCK : (pv < -MACHINE_PULSE_BLOCK ? -MACHINE_PULSE_BLOCK : pv);
+            if (pv) {
+                Axis &a(*motorAxis[i]);
+                block.value[i] = (StepDV) pv;
+                a.position = motorPos.value[i] - pv; // permit infinite travel
+                usBlock = max(usBlock, (int32_t) a.usDelay * (pv < 0 ? -pv : pv));
+            }
+        }
+
+        Status status = stepDirection(block);
+        if (status == STATUS_OK) {
+            status = stepFast(block);
+        }
+        setMotorPosition(motorPos);
         if (status != STATUS_OK) {
             return status;
         }
-        pulses -= pulse;
+        for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+            pulses.value[i] -= block.value[i];
+        }
+        delayMics(usBlock); // maximum pulse rate throttle
     }
 
     return STATUS_OK;
 }
 
 
-int8_t Machine::stepHome(int16_t pulsesPerAxis, int16_t searchDelay) {
-    int8_t pulses = 0;
-
-    for (int8_t iPulse = 0; iPulse < pulsesPerAxis; iPulse++) {
-        for (uint8_t i = 0; i < QUAD_ELEMENTS; i++) {
-            Axis &a(*motorAxis[i]);
-            if (a.homing && a.enabled) {
-                a.readAtMin(invertLim);
-                if (a.atMin) {
-                    a.homing = false;
-                    delayMics(100000); // wait 0.1s for machine to settle
-                    for (StepCoord lb = a.latchBackoff; lb > 0; lb--) {
-                        a.pulse(true);
-                        delayMics(a.searchDelay);
-                    }
-                } else {
-                    a.pulse(false);
-                    pulses++;
-                }
-            }
-        }
-        delayMics(searchDelay); // maximum pulse rate throttle
-    }
-
-    return pulses;
-}
-
 /**
  * Return position of currently driven axes bound to motors
  */
@@ -479,3 +736,110 @@ void Machine::setMotorPosition(const Quad<StepCoord> &position) {
 
 
 
+
+/**
+ * Return the free ring buffer for the next stroke to be queued,
+ * or NULL if the stroke ring is full. The current stroke buffer
+ * is reused when no strokes are queued.
+ */
+Stroke* Machine::strokeBuffer() {
+    if (nStrokes >= STROKE_BUFFERS) {
+        return NULL;
+    }
+    return &strokeRing[(iStroke + nStrokes) % STROKE_BUFFERS];
+}
+
+/**
+ * Limit each motor of the stroke builder to the pulse rate of its axis.
+ * Axis usDelay is the minimum time between pulses, so a motor whose axis
+ * has no usDelay is only limited by the builder vMax.
+ */
+void Machine::setStrokeLimits(StrokeBuilder &sb) {
+    for (MotorIndex i = 0; i < MOTOR_COUNT; i++) {
+        DelayMics usDelay = motorAxis[i]->usDelay;
+        sb.motorVMax[i] = usDelay > 0 ? 1000000L / usDelay : 0;
+    }
+}
+
+/**
+ * Return the tick at which a stroke queued now should start:
+ * the exact end of the last queued stroke, or tNow if no strokes are queued
+ */
+Ticks Machine::strokeStartTicks(Ticks tNow) {
+    if (nStrokes == 0) {
+        return tNow;
+    }
+    Stroke &last = strokeRing[(iStroke + nStrokes - 1) % STROKE_BUFFERS];
+    return last.tStart + last.get_dtTotal();
+}
+
+/**
+ * Append the stroke initialized in strokeBuffer() to the stroke queue
+ */
+void Machine::queueStroke() {
+    if (nStrokes < STROKE_BUFFERS) {
+        nStrokes++;
+    }
+}
+
+/**
+ * Release the current stroke and advance to the next queued stroke.
+ * The last stroke remains current so that its position can be reported.
+ */
+void Machine::dequeueStroke() {
+    if (nStrokes > 0) {
+        nStrokes--;
+        if (nStrokes > 0) {
+            iStroke = (iStroke + 1) % STROKE_BUFFERS;
+        }
+    }
+}
+
+/**
+ * Discard all queued strokes
+ */
+void Machine::clearStrokes() {
+    nStrokes = 0;
+}
+
+/**
+ * Stop homing all axes
+ */
+void Machine::clearHome() {
+    for (AxisIndex i = 0; i < AXIS_COUNT; i++) {
+        axis[i].homing = false;
+        axis[i].homePhase = HOME_IDLE;
+    }
+}
+
+/**
+ * Abandon the current moveTo() move, if any
+ */
+void Machine::clearMove() {
+    moving = false;
+}
+
+/**
+ * Scale the speed of the current and queued strokes and of the generated
+ * line to the given percentage of their planned speed. The current stroke
+ * continues from its present position and queued strokes still start on
+ * the tick that the preceding stroke ends.
+ */
+Status Machine::setFeedRate(int16_t percent, Ticks tNow) {
+    if (percent < FEED_RATE_MIN || FEED_RATE_MAX < percent) {
+        return STATUS_FIELD_RANGE_ERROR;
+    }
+    feedRate = percent;
+    for (uint8_t i = 0; i < nStrokes; i++) {
+        Stroke &s = strokeRing[(iStroke + i) % STROKE_BUFFERS];
+        s.setFeedRate(tNow, percent);
+        if (i > 0) {
+            Stroke &prev = strokeRing[(iStroke + i - 1) % STROKE_BUFFERS];
+            s.tStart = prev.tStart + prev.get_dtTotal();
+        }
+    }
+#ifdef STROKE_GENERATOR
+    lineGenerator.setFeedRate(tNow, percent);
+#endif
+    return STATUS_OK;
+}
@@ -2,6 +2,7 @@
 #define MACHINE_H
 
 #include "Stroke.h"
+#include "StepEngine.h"
 #include "Display.h"
 #include "pins.h"
 
@@ -9,10 +10,16 @@ extern void test_Home();
 
 namespace firestep {
 
-// #define THROTTLE_SPEED /* Throttles driver speed from high (255) to low (0) */
+// #define THROTTLE_SPEED /* ADC speed knob sets stroke feed rate from FEED_RATE_MAX (255) to FEED_RATE_MIN (0); mov and ho are not throttled */
+// #define STEP_ENGINE /* Stroke pulses are queued and emitted by the Timer1 compare ISR */
 
 
 #define DELTA_COUNT 120
+#ifndef STROKE_BUFFERS
+#define STROKE_BUFFERS 1 /* 2: stream back-to-back dvs/lin strokes (RAM: STROKE_BUFFERS*sizeof(Stroke)) */
+#endif
+#define FEED_RATE_MIN 25 /* minimum stroke feed rate override (percent) */
+#define FEED_RATE_MAX 200 /* maximum stroke feed rate override (percent) */
 #define MOTOR_COUNT 4
 #define AXIS_COUNT 6
 #define PIN_ENABLE LOW
@@ -50,6 +57,18 @@ enum AxisIndexValue {
     NO_AXIS = INDEX_NONE
 };
 
+enum HomePhase {
+    HOME_IDLE = 0,		// not homing
+    HOME_SEEK = 1,		// fast approach to minimum limit switch
+    HOME_BACKOFF = 2,	// back off latchBackoff pulses
+    HOME_LATCH = 3,		// slow approach to minimum limit switch
+    HOME_RELEASE = 4,	// back off latchBackoff pulses to home
+};
+
+#define HOME_SEEK_DIVISOR 2 /* HOME_SEEK pulses searchDelay/HOME_SEEK_DIVISOR apart */
+#define HOME_PULSES 32 /* maximum pulses per axis for each home() invocation */
+#define MACHINE_PULSE_BLOCK 127 /* maximum pulses per motor for each pulse() block */
+
 typedef class Axis {
         friend void ::test_Home();
         friend class Machine;
@@ -61,6 +80,8 @@ typedef class Axis {
         PinType 	pinMin; // homing minimum limit switch
         PinType 	pinMax;	// maximum limit switch (optional)
         PinType 	pinEnable; // stepper driver enable pin (nENBL)
+        volatile uint8_t *stepPort; // pinStep port output register (NULL for NOPIN)
+        uint8_t		stepMask; // pinStep bit in stepPort
         StepCoord	home; // home position
         StepCoord 	travelMin; // soft minimum travel limit
         StepCoord 	travelMax; // soft maximum travel limit
@@ -76,6 +97,9 @@ typedef class Axis {
         bool		atMin; // minimum limit switch (last value read)
         bool		atMax; // maximum limit switch (last value read)
         bool		homing; // true:axis is active for homing
+        uint8_t		homePhase; // HomePhase of homing axis
+        StepCoord	homePulses; // pulses left in HOME_BACKOFF or HOME_RELEASE
+        int32_t		homeMics; // homing pulse time not yet spent (microseconds)
 
         Axis() :
             pinStep(NOPIN),
@@ -83,6 +107,8 @@ typedef class Axis {
             pinMin(NOPIN),
             pinMax(NOPIN),
             pinEnable(NOPIN),
+            stepPort(NULL),
+            stepMask(0),
             home(0),
             travelMin(0),
             travelMax(32000),	// 5 full 400-step revolutions @16-microsteps
@@ -98,7 +124,10 @@ typedef class Axis {
             atMin(false),
             atMax(false),
             enabled(false),
-            homing(false)
+            homing(false),
+            homePhase(HOME_IDLE),
+            homePulses(0),
+            homeMics(0)
         {};
         Status enable(bool active);
         bool isEnabled() {
@@ -111,12 +140,32 @@ typedef class Axis {
             ::pinMode(pin, mode);
             return STATUS_OK;
         }
-        inline void pulse(bool advance) {
+        inline void setAdvancing(bool advance) {
             if (advance != advancing) {
                 advancing = advance;
                 digitalWrite(pinDir, (advance == dirHIGH) ? HIGH : LOW);
             }
-			pulseFast(pinStep);
+        }
+        inline void pulse(bool advance) {
+            setAdvancing(advance);
+            if (stepMask) {
+                pulsePort(stepPort, stepMask);
+            }
+        }
+        inline DelayMics homeDelay() {
+            DelayMics us = homePhase == HOME_SEEK ? searchDelay / HOME_SEEK_DIVISOR : searchDelay;
+            us = max(us, usDelay);
+            return us > 0 ? us : 1;
+        }
+        inline void cacheStepPort() {
+            uint8_t port = pinStep == NOPIN ? NOT_A_PIN : digitalPinToPort(pinStep);
+            if (port == NOT_A_PIN) {
+                stepPort = NULL;
+                stepMask = 0;
+            } else {
+                stepPort = portOutputRegister(port);
+                stepMask = digitalPinToBitMask(pinStep);
+            }
         }
         inline Status readAtMin(bool invertLim) {
             if (pinMin == NOPIN) {
@@ -149,64 +198,73 @@ typedef class Machine : public QuadStepper {
     private:
         bool	pinEnableHigh;
         Display nullDisplay;
-        int8_t 	stepHome(int16_t pulsesPerAxis, int16_t searchDelay);
+        Ticks	tHome;	// last home() time
+        bool	homePulse(Axis &a);
         Axis *	motorAxis[MOTOR_COUNT];
         AxisIndex	motor[MOTOR_COUNT];
         PinConfig	pinConfig;
+        Stroke	strokeRing[STROKE_BUFFERS];
+        uint8_t	iStroke;	// ring index of current stroke
+        uint8_t	nStrokes;	// queued strokes including current
+        int16_t	feedRate;	// stroke feed rate override (percent)
+        uint8_t	limitPollCount;	// stepDirection() calls since last limit switch poll
+        StepPorts	stepPorts;	// motor step pins grouped by port
+        void	updateStepPorts();
+        bool	moving;	// moveTo() is in progress
+        Ticks	tMoveStart;	// moveTo() start time
+        Ticks	dtMove;	// moveTo() duration
+        Quad<StepCoord>	moveFrom;	// moveTo() start position
+        Quad<StepCoord>	moveGoal;	// moveTo() destination
+        Status	moveStart(Quad<StepCoord> destination, float seconds, Ticks tNow);
+        float	moveFraction(Ticks tNow);
+        Status	stepDirectionChecked(const Quad<StepDV> &pulse);
 
     public:
         bool	invertLim;
+        uint8_t	limitPoll;	// travel checked stroke blocks per limit switch poll (default 1)
         bool	jsonPrettyPrint;
         Display	*pDisplay;
         Axis axis[AXIS_COUNT];
-        Stroke stroke;
+#ifdef STROKE_CACHE_SIZE
+        StrokeCache strokeCache;
+#endif
+#ifdef STROKE_GENERATOR
+        StrokeGenerator lineGenerator;
+#endif
+#ifdef STEP_ENGINE
+        StepEngine stepEngine;
+#endif
 
     public:
         Machine();
         void enable(bool active);
         virtual Status step(const Quad<StepDV> &pulse);
-		inline int8_t pulsePin(int16_t pinStep, int8_t n) {
-			switch (n) {
-			case 0:
-				pulseFast(pinStep);
-				pulseFast(pinStep);
-				pulseFast(pinStep);
-				pulseFast(pinStep);
-				return 4;
-			case 3:
-				pulseFast(pinStep);
-				pulseFast(pinStep);
-				pulseFast(pinStep);
-				return 3;
-			case 2:
-				pulseFast(pinStep);
-				pulseFast(pinStep);
-				return 2;
-			case 1:
-				pulseFast(pinStep);
-				return 1;
-			}
-		}
+        /**
+         * Emit one pulse per round to each motor with pulses remaining.
+         * Motors whose step pins share a port are pulsed with a single
+         * write for each edge.
+         */
         inline Status stepFast(Quad<StepDV> &pulse) {
-			Quad<StepDV> p(pulse);
-			//TESTCOUT4("stepFast ", (int) p.value[0], ",", (int) p.value[1], ",", 
-				//(int) p.value[2], ",", (int) p.value[3]);
+			uint8_t n[QUAD_ELEMENTS];
+			for (uint8_t i=0; i<QUAD_ELEMENTS; i++) {
+				int8_t pv = pulse.value[i];
+				n[i] = pv < 0 ? -pv : pv;
+			}
 			for (bool hasPulses=true; hasPulses;) {
 				hasPulses = false;
+				uint8_t portMask[MOTOR_COUNT] = {0};
 				for (uint8_t i=0; i<QUAD_ELEMENTS; i++) {
-					// emit 0-4 pulse burst per axis
-					int16_t pinStep = motorAxis[i]->pinStep;
-					int8_t pv = p.value[i];
-					if (pv > 0) {
-						p.value[i] -= pulsePin(pinStep, pv & (int8_t) 0x3);
-						hasPulses = true;
-					} else if (pv < 0) {
-						p.value[i] += pulsePin(pinStep, -pv & (int8_t) 0x3);
+					if (n[i]) {
+						n[i]--;
+						portMask[stepPorts.motorPort[i]] |= stepPorts.motorMask[i];
 						hasPulses = true;
 					}
 				}
-				//TESTCOUT4("stepFast => ", (int) p.value[0], ",", (int) p.value[1], ",", 
-					//(int) p.value[2], ",", (int) p.value[3]);
+				for (uint8_t iPort=0; iPort<stepPorts.nPorts; iPort++) {
+					if (portMask[iPort]) {
+						pulsePort(stepPorts.port[iPort], portMask[iPort]);
+					}
+				}
 			}
 
             return STATUS_OK;
@@ -216,7 +274,7 @@ typedef class Machine : public QuadStepper {
         void setPin(PinType &pinDst, PinType pinSrc, int16_t mode, int16_t value = LOW);
         Quad<StepCoord> getMotorPosition();
         void setMotorPosition(const Quad<StepCoord> &position);
-        virtual Status home();
+        Status home(Ticks tNow);
         void idle();
         Status setAxisIndex(MotorIndex iMotor, AxisIndex iAxis);
         AxisIndex getAxisIndex(MotorIndex iMotor) {
@@ -225,7 +283,7 @@ typedef class Machine : public QuadStepper {
         Axis& getMotorAxis(MotorIndex iMotor) {
             return axis[motor[iMotor]];
         }
-        Status moveTo(Quad<StepCoord> destination, float seconds);
+        Status moveTo(Quad<StepCoord> destination, float seconds, Ticks tNow);
         Status moveDelta(Quad<StepCoord> delta, float seconds);
         MotorIndex motorOfName(const char* name);
         AxisIndex axisOfName(const char *name);
@@ -233,6 +291,35 @@ typedef class Machine : public QuadStepper {
         PinConfig getPinConfig() {
             return pinConfig;
         }
+        const StepPorts& getStepPorts() {
+            return stepPorts;
+        }
+        inline Stroke& stroke() {
+            return strokeRing[iStroke];
+        }
+        inline QuadStepper& strokeStepper() {
+#ifdef STEP_ENGINE
+            return stepEngine;
+#else
+            return *this;
+#endif
+        }
+        uint8_t getStrokeCount() {
+            return nStrokes;
+        }
+        Stroke* strokeBuffer();
+        Ticks strokeStartTicks(Ticks tNow);
+        void queueStroke();
+        void dequeueStroke();
+        void clearStrokes();
+        void clearMove();
+        void clearHome();
+        int16_t getFeedRate() {
+            return feedRate;
+        }
+        Status setFeedRate(int16_t percent, Ticks tNow);
+        void setStrokeLimits(StrokeBuilder &sb);
+        Status checkStrokeTravel(Stroke &stroke);
 } Machine;
 
 #ifdef TEST
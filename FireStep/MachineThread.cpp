@@ -11,7 +11,7 @@ using namespace firestep;
 void MachineThread::setup() {
     id = 'M';
 #ifdef THROTTLE_SPEED
-    ADC_LISTEN8(ANALOG_SPEED_PIN);
+    ADC_LISTEN8(PC2_ANALOG_SPEED_PIN);
 #endif
     Thread::setup();
 	machine.pDisplay->setup();
@@ -21,7 +21,105 @@ void MachineThread::setup() {
 }
 
 MachineThread::MachineThread()
-    : status(STATUS_WAIT_IDLE) , controller(machine) {
+    : parked(false), speed(-1), status(STATUS_WAIT_IDLE), statusNext(STATUS_WAIT_IDLE), controller(machine) {
+}
+
+/**
+ * Return true if serial input should be read ahead while the current
+ * dvs or lin stroke or generated lin line traverses. Input is read ahead
+ * for a feed rate override and, if STROKE_BUFFERS > 1, for the stroke
+ * that follows a stroke.
+ */
+bool MachineThread::isStreaming() {
+    return status == STATUS_BUSY_MOVING &&
+           statusNext != STATUS_BUSY_MOVING &&
+           (parked || controller.isStroke(command) || controller.isGeneratedLine(command));
+}
+
+/**
+ * Read the look-ahead command. The response of the current stroke is
+ * parked in the controller so that the command buffer is free.
+ * If STROKE_BUFFERS > 1, a lone dvs or lin stroke that follows a stroke is
+ * initialized in the next stroke buffer to start on the tick the current
+ * stroke ends.
+ * A lone feed rate override is applied immediately to the current stroke or line.
+ * Any other input cancels the current stroke.
+ */
+void MachineThread::readNext() {
+    if (statusNext != STATUS_WAIT_EOL) {
+        if (!parked) {
+            if (!controller.parkStroke(command)) {
+                statusNext = STATUS_WAIT_CANCELLED; // response too long to park
+                return;
+            }
+            parked = true;
+        }
+        command.clear();
+    }
+    statusNext = command.parse();
+    switch (statusNext) {
+    case STATUS_WAIT_EOL:
+        break;
+    case STATUS_BUSY_PARSED:
+#if STROKE_BUFFERS > 1
+        if (controller.isStroke(command) && !controller.isParkedLine()) {
+            statusNext = controller.process(command);
+            if (statusNext != STATUS_BUSY_MOVING) {
+                statusNext = STATUS_WAIT_IDLE; // rejected with response
+            }
+            break;
+        }
+#endif
+        if (controller.isFeedRate(command)) {
+            controller.process(command);
+            statusNext = STATUS_WAIT_IDLE; // applied with response
+        }
+        break;
+    default: // empty line or parse error
+        statusNext = STATUS_WAIT_CANCELLED;
+        break;
+    }
+}
+
+/**
+ * Cancel current and queued commands. A parsed look-ahead command
+ * becomes the current command.
+ */
+void MachineThread::cancelCommands() {
+    if (parked) {
+        status = controller.cancelParked(STATUS_SERIAL_CANCEL);
+        parked = false;
+        if (statusNext == STATUS_BUSY_MOVING) {
+            controller.cancel(command, STATUS_SERIAL_CANCEL);
+        } else if (statusNext == STATUS_BUSY_PARSED) {
+            status = STATUS_BUSY_PARSED;
+        }
+    } else {
+        status = controller.cancel(command, STATUS_SERIAL_CANCEL);
+    }
+    statusNext = STATUS_WAIT_IDLE;
+}
+
+/**
+ * Current command is done. Continue with the look-ahead command.
+ */
+void MachineThread::nextCommand() {
+    parked = false;
+    switch (statusNext) {
+    case STATUS_BUSY_MOVING:
+        if (status == STATUS_OK) {
+            status = STATUS_BUSY_MOVING; // queued stroke is already started
+        } else {
+            controller.cancel(command, status);
+        }
+        break;
+    case STATUS_WAIT_EOL:
+        status = STATUS_WAIT_EOL;
+        break;
+    default:
+        break;
+    }
+    statusNext = STATUS_WAIT_IDLE;
 }
 
 void MachineThread::displayStatus() {
@@ -65,16 +163,10 @@ void MachineThread::displayStatus() {
 
 void MachineThread::loop() {
 #ifdef THROTTLE_SPEED
-    controller.speed = ADCH;
-    if (controller.speed <= 251) {
-        ThreadEnable(false);
-        for (byte iPause = controller.speed; iPause <= 247; iPause++) {
-            for (byte iIdle = 0; iIdle < 10; iIdle++) {
-                DELAY500NS;
-                DELAY500NS;
-            }
-        }
-        ThreadEnable(true);
+    if (speed < 0 || ADCH > speed + 2 || ADCH + 2 < speed) { // ignore knob jitter
+        speed = ADCH;
+        machine.setFeedRate(FEED_RATE_MIN +
+                            ((int32_t)(FEED_RATE_MAX - FEED_RATE_MIN) * speed) / 255, ticks());
     }
 #endif
 
@@ -101,10 +193,17 @@ void MachineThread::loop() {
     case STATUS_BUSY_PARSED:
     case STATUS_BUSY:
     case STATUS_BUSY_MOVING:
-		if (Serial.available()) {
-			status = controller.cancel(command, STATUS_SERIAL_CANCEL);
+		if (Serial.available() && isStreaming()) {
+			readNext();
+		}
+		if (statusNext == STATUS_BUSY_PARSED || statusNext == STATUS_WAIT_CANCELLED ||
+				(Serial.available() && !isStreaming())) {
+			cancelCommands();
 		} else {
-			status = controller.process(command);
+			status = parked ? controller.processParked() : controller.process(command);
+			if (!isProcessing(status)) {
+				nextCommand();
+			}
 		}
         break;
 	case STATUS_BUSY_SETUP: {
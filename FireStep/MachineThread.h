@@ -10,11 +10,20 @@ namespace firestep {
 typedef class MachineThread : Thread {
         friend void test_Home();
 
+    private:
+        bool parked;				// current stroke response is parked in controller
+        int16_t speed;				// THROTTLE_SPEED knob reading (-1: not read yet)
+        bool isStreaming();
+        void readNext();
+        void cancelCommands();
+        void nextCommand();
+
     protected:
         void displayStatus();
 
     public:
         Status status;
+        Status statusNext;			// look-ahead command status
         Machine machine;
         JsonCommand command;
         JsonController controller;
@@ -38,6 +38,7 @@ enum Status {
 	STATUS_PIN_CONFIG = -132,		// Invalid pin configuration
 	STATUS_VALUE_RANGE = -133,		// Provided value out of range
 	STATUS_STATE = -134,			// Internal error: invalid state
+	STATUS_KINEMATIC_XYZ = -135,	// Delta effector position is unreachable
 
 	// stroke
 	STATUS_STROKE_SEGPULSES = -200,	// Stroke has too many pulses per segment [-127,127]
@@ -46,6 +47,11 @@ enum Status {
     STATUS_STROKE_TIME = -203,		// Stroke planMicros < TICK_MICROSECONDS
     STATUS_STROKE_START = -204,		// Stroke start() must be called before traverse()
     STATUS_STROKE_NULL_ERROR = -205,// Stroke has no segments
+    STATUS_STROKE_QUEUE_FULL = -206,// Stroke ring has no free buffer
+    STATUS_STROKE_CACHE_ID = -207,	// Stroke cache has no line with given id
+    STATUS_STROKE_DEVIATION = -208,	// Stroke exceeds maxDeviation with maxSegments
+    STATUS_STROKE_GENERATOR = -209,	// Stroke generator is not available (STROKE_GENERATOR)
+    STATUS_STROKE_DDA = -210,		// Stroke DDA traversal is not available (STEP_ENGINE)
 
 	// JSON parsing
     STATUS_JSON_BRACE_ERROR=-400,	// Unbalanced JSON braces
@@ -68,6 +74,7 @@ enum Status {
     STATUS_FIELD_REQUIRED = -419,	// Expected JSON field value
     STATUS_JSON_ARRAY_LEN = -420,	// JSON array is too short
     STATUS_OUTPUT_FIELD = -421,		// JSON field is for output only
+    STATUS_FIELD_BASE64 = -422,		// Invalid base64 JSON field value
 
 	// events
 	STATUS_ESTOP = -900,			// Emergency hardware stop
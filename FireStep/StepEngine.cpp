@@ -0,0 +1,265 @@
+#ifdef CMAKE
+#include <cstring>
+#endif
+
+#include "Machine.h"
+#include "StepEngine.h"
+
+using namespace firestep;
+
+static StepEngine *pIsrEngine; // engine served by Timer1 compare ISR
+
+#if defined(ARDUINO) && defined(STEP_ENGINE)
+ISR(TIMER1_COMPA_vect) {
+    pIsrEngine->isr();
+}
+#endif
+
+#ifdef TEST
+static void isrTimer1CompA() {
+    pIsrEngine->isr();
+}
+#endif
+
+StepEngine::StepEngine()
+    : pStepper(NULL), pPorts(NULL), armed(false),
+      tSample(0), dtSample(STEPENGINE_MAXDT), tEmit(0) {
+}
+
+void StepEngine::setup(QuadStepper &stepper, const StepPorts &ports) {
+    pStepper = &stepper;
+    pPorts = &ports;
+}
+
+/**
+ * Discard queued pulses
+ */
+void StepEngine::clear() {
+    cli();
+    TIMSK1 &= ~(1 << OCIE1A);
+    armed = false;
+    queue.clear();
+    sei();
+}
+
+/**
+ * Enable the compare ISR for the oldest queued pulse if it is not already running
+ */
+void StepEngine::arm() {
+    cli();
+    if (!armed && !queue.isEmpty()) {
+        uint16_t tNow = TIMER_VALUE();
+        uint16_t tNext = queue.front().tEmit;
+        OCR1A = ((int16_t)(tNext - tNow) > 0) ? tNext : (uint16_t)(tNow + 1);
+        pIsrEngine = this;
+#ifdef TEST
+        arduino.isrTimer1CompA = isrTimer1CompA;
+#endif
+        TIMSK1 |= (1 << OCIE1A);
+        armed = true;
+    }
+    sei();
+}
+
+/**
+ * Return STATUS_OK if the queue has room for n unit pulses,
+ * or STATUS_BUSY if the ISR must drain it first
+ */
+Status StepEngine::reserve(int16_t n) {
+    if (n >= STEPQUEUE_SIZE) {
+        return STATUS_STEP_RANGE_ERROR;
+    }
+    if (n > STEPQUEUE_SIZE - 1 - queue.count()) {
+        arm();
+        return STATUS_BUSY;
+    }
+    return STATUS_OK;
+}
+
+/**
+ * Queue the step pin port writes of a unit pulse. The caller reserves room.
+ */
+void StepEngine::enqueue(const Quad<StepDV> &unit, uint16_t t) {
+    StepEvent &event = queue.back();
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        event.portMask[i] = 0;
+    }
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        if (unit.value[i]) {
+            event.portMask[pPorts->motorPort[i]] |= pPorts->motorMask[i];
+        }
+    }
+    event.tEmit = t;
+    queue.push();
+}
+
+/**
+ * Queue dPos as unit pulses of a multi-axis DDA spaced evenly over
+ * dt ticks from tStart. The caller reserves room.
+ */
+void StepEngine::enqueueSpread(const Quad<StepCoord> &dPos, uint16_t tStart, Ticks dt) {
+    StepCoord n = 0;
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        n = max(n, (StepCoord) abs(dPos.value[i]));
+    }
+    int16_t err[QUAD_ELEMENTS];
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        err[i] = n / 2;
+    }
+    Quad<StepDV> unit;
+    for (StepCoord k = 0; k < n; k++) {
+        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+            err[i] += abs(dPos.value[i]);
+            if (err[i] >= n) {
+                err[i] -= n;
+                unit.value[i] = dPos.value[i] < 0 ? -1 : 1;
+            } else {
+                unit.value[i] = 0;
+            }
+        }
+        tEmit = tStart + (uint16_t)(((int32_t) k * dt) / n);
+        enqueue(unit, tEmit);
+    }
+    arm();
+}
+
+/**
+ * ProtocolA: queue a single unit pulse for the next available tick
+ */
+Status StepEngine::step(const Quad<StepDV> &pulse) {
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        if (pulse.value[i] < -1 || 1 < pulse.value[i]) {
+            return STATUS_STEP_RANGE_ERROR;
+        }
+    }
+    Status result = stepDirection(pulse);
+    if (result != STATUS_OK) {
+        return result;
+    }
+    uint16_t tNow = (uint16_t) threadClock.ticks;
+    if ((int16_t)(tEmit - tNow) < 0) {
+        tEmit = tNow;
+    }
+    enqueue(pulse, tEmit);
+    arm();
+    return STATUS_OK;
+}
+
+/**
+ * ProtocolB: reserve room for the pulse block and apply its direction,
+ * position and limits with the target stepper. Returns STATUS_BUSY
+ * without side effects if the queue is too full or if a motor reverses
+ * before its queued pulses have been emitted.
+ */
+Status StepEngine::stepDirection(const Quad<StepDV> &pulse) {
+    int16_t n = 0;
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        n = max(n, (int16_t) abs(pulse.value[i]));
+    }
+    Status result = reserve(n);
+    if (result != STATUS_OK) {
+        return result;
+    }
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        StepDV dir = pulse.value[i] < 0 ? -1 : (pulse.value[i] > 0 ? 1 : 0);
+        if (dir && dir != dirQueued.value[i] && !queue.isEmpty()) {
+            arm();
+            return STATUS_BUSY;
+        }
+    }
+    result = pStepper->stepDirection(pulse);
+    if (result != STATUS_OK) {
+        return result;
+    }
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        if (pulse.value[i]) {
+            dirQueued.value[i] = pulse.value[i] < 0 ? -1 : 1;
+        }
+    }
+    return STATUS_OK;
+}
+
+/**
+ * ProtocolB: queue pulse bursts as unit pulses spread evenly over
+ * the interval between planner samples
+ */
+Status StepEngine::stepFast(Quad<StepDV> &pulse) {
+    int16_t n = 0;
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        n = max(n, (int16_t) abs(pulse.value[i]));
+    }
+    Status result = reserve(n);
+    if (result != STATUS_OK) {
+        return result;
+    }
+
+    Ticks tNow = threadClock.ticks;
+    if (tNow != tSample) {
+        Ticks dt = tNow - tSample;
+        dtSample = (dt < 1) ? 1 : (dt > STEPENGINE_MAXDT ? STEPENGINE_MAXDT : dt);
+        tSample = tNow;
+    }
+    uint16_t tStart = (uint16_t) tNow;
+    if ((int16_t)(tEmit - tStart) > 0) {
+        tStart = tEmit; // queue is behind the planner
+    }
+
+    Quad<StepCoord> dPos(pulse.value[0], pulse.value[1], pulse.value[2], pulse.value[3]);
+    enqueueSpread(dPos, tStart, dtSample);
+    return STATUS_OK;
+}
+
+/**
+ * ProtocolC: queue the segment pulses as unit pulses evenly spaced
+ * over dt ticks, starting now or after the last queued pulse.
+ * Segments must be shorter than the queue (see traverseDDA()).
+ */
+Status StepEngine::stepSegment(const Quad<StepCoord> &dPos, Ticks dt) {
+    StepCoord n = 0;
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        n = max(n, (StepCoord) abs(dPos.value[i]));
+    }
+    if (n >= STEPQUEUE_SIZE) {
+        return STATUS_STEP_RANGE_ERROR;
+    }
+    Quad<StepDV> pulse(dPos.value[0], dPos.value[1], dPos.value[2], dPos.value[3]);
+    Status result = stepDirection(pulse);
+    if (result != STATUS_OK) {
+        return result;
+    }
+
+    uint16_t tStart = (uint16_t) threadClock.ticks;
+    if ((int16_t)(tEmit - tStart) > 0) {
+        tStart = tEmit;
+    }
+    enqueueSpread(dPos, tStart, dt);
+    return STATUS_OK;
+}
+
+/**
+ * Timer1 compare ISR: write the step pin ports of all pulses that are
+ * due and schedule the compare register for the next one.
+ */
+void StepEngine::isr() {
+    for (;;) {
+        if (queue.isEmpty()) {
+            TIMSK1 &= ~(1 << OCIE1A);
+            armed = false;
+            return;
+        }
+        StepEvent &event = queue.front();
+        if ((int16_t)(event.tEmit - (uint16_t) TIMER_VALUE()) > 0) {
+            OCR1A = event.tEmit;
+            if ((int16_t)(event.tEmit - (uint16_t) TIMER_VALUE()) > 0) {
+                return; // not yet due
+            }
+            continue; // timer passed tEmit while setting OCR1A
+        }
+        for (uint8_t iPort = 0; iPort < pPorts->nPorts; iPort++) {
+            if (event.portMask[iPort]) {
+                pulsePort(pPorts->port[iPort], event.portMask[iPort]);
+            }
+        }
+        queue.pop();
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef STEPENGINE_H
+#define STEPENGINE_H
+
+#include "Stroke.h"
+
+namespace firestep {
+
+#define STEPQUEUE_SIZE 64 /* power of two; one slot is always free */
+#define STEPENGINE_MAXDT 32 /* maximum ticks over which one planner sample of pulses is spread */
+
+/**
+ * Step pin port registers of the motors. Motors whose step pins share
+ * a port are pulsed with a single write for each edge.
+ */
+typedef struct StepPorts {
+    volatile uint8_t	*port[QUAD_ELEMENTS];	// distinct motor step pin port registers
+    uint8_t				nPorts;
+    uint8_t				motorPort[QUAD_ELEMENTS];	// port index of each motor
+    uint8_t				motorMask[QUAD_ELEMENTS];	// step pin bit of each motor (0: NOPIN)
+} StepPorts;
+
+typedef struct StepEvent {
+    uint8_t		portMask[QUAD_ELEMENTS];	// step pins of each StepPorts port to pulse
+    uint16_t	tEmit;	// TIMER_VALUE() at which pulse is emitted
+} StepEvent;
+
+/**
+ * Lock-free single-producer/single-consumer queue of StepEvents.
+ * The producer (planner) only writes head and the consumer (ISR)
+ * only writes tail. Both indexes are single bytes, so they are
+ * read and written atomically without disabling interrupts.
+ */
+typedef class StepQueue {
+    private:
+        StepEvent			buf[STEPQUEUE_SIZE];
+        volatile uint8_t	head;	// next slot to write
+        volatile uint8_t	tail;	// next slot to read
+
+    public:
+        StepQueue() : head(0), tail(0) {}
+        inline bool isEmpty() {
+            return head == tail;
+        }
+        inline bool isFull() {
+            return ((head + 1) & (STEPQUEUE_SIZE - 1)) == tail;
+        }
+        inline uint8_t count() {
+            return (head - tail) & (STEPQUEUE_SIZE - 1);
+        }
+        inline StepEvent& back() { // producer fills back() then calls push()
+            return buf[head];
+        }
+        inline void push() {
+            head = (head + 1) & (STEPQUEUE_SIZE - 1);
+        }
+        inline StepEvent& front() { // consumer reads front() then calls pop()
+            return buf[tail];
+        }
+        inline void pop() {
+            tail = (tail + 1) & (STEPQUEUE_SIZE - 1);
+        }
+        inline void clear() { // consumer discards all queued events
+            tail = head;
+        }
+} StepQueue;
+
+/**
+ * QuadStepper that queues unit pulses for the Timer1 compare ISR,
+ * which emits them at precise timer ticks by writing the step pin
+ * ports directly. Direction, position and limits are handled by the
+ * target QuadStepper when pulses are queued, so a direction reversal
+ * waits until the queued pulses have been emitted.
+ * The pulses of each planner sample are spread evenly over the
+ * interval since the previous sample, so slow work in the cooperative
+ * loop no longer shows up as step jitter. When the queue has no room
+ * for a pulse block, STATUS_BUSY is returned and the planner retries
+ * on its next loop.
+ */
+typedef class StepEngine : public QuadStepper {
+    private:
+        QuadStepper			*pStepper;	// target stepper for direction, position and limits
+        const StepPorts		*pPorts;	// step pin ports pulsed by the ISR
+        StepQueue			queue;
+        volatile bool		armed;		// ISR is enabled
+        Quad<StepDV>		dirQueued;	// direction of queued pulses of each motor
+        Ticks				tSample;	// threadClock ticks of current planner sample
+        uint16_t			dtSample;	// ticks between planner samples
+        uint16_t			tEmit;		// TIMER_VALUE() of last queued pulse
+
+    private:
+        Status reserve(int16_t n);
+        void enqueue(const Quad<StepDV> &unit, uint16_t t);
+        void enqueueSpread(const Quad<StepCoord> &dPos, uint16_t tStart, Ticks dt);
+        void arm();
+
+    public:
+        StepEngine();
+        void setup(QuadStepper &stepper, const StepPorts &ports);
+        void clear();
+        virtual Status step(const Quad<StepDV> &pulse);
+        virtual Status stepDirection(const Quad<StepDV> &pulse);
+        virtual Status stepFast(Quad<StepDV> &pulse);
+        virtual Status stepSegment(const Quad<StepCoord> &dPos, Ticks dt);
+        void isr();
+        inline bool isIdle() {
+            return queue.isEmpty();
+        }
+        inline uint8_t getQueued() {
+            return queue.count();
+        }
+} StepEngine;
+
+} // namespace firestep
+
+#endif
@@ -1,8 +1,10 @@
 #ifdef CMAKE
 #include <cstring>
+#include <cmath>
 #endif
 
 #include "Stroke.h"
+#include "DeltaCalculator.h"
 
 using namespace firestep;
 using namespace ph5;
@@ -25,18 +27,55 @@ float Stroke::getTimePlanned() {
 
 void Stroke::setTimePlanned(float seconds) {
 	ASSERT(seconds > 0);
-	dtTotal = MS_TICKS_REAL(seconds * 1000);
+	dtPlanned = dtTotal = MS_TICKS_REAL(seconds * 1000);
+}
+
+void Stroke::setTotalTicks(Ticks dt) {
+	ASSERT(dt > 0);
+	dtPlanned = dtTotal = dt;
+}
+
+/**
+ * Rescale traversal time to the given percentage of planned speed.
+ * A stroke in progress keeps its fractional progress so that
+ * goalPos() remains continuous at tNow.
+ */
+void Stroke::setFeedRate(Ticks tNow, int16_t percent) {
+	if (percent <= 0 || dtPlanned <= 0) {
+		return;
+	}
+	Ticks dtNew = (dtPlanned * 100) / percent;
+	if (dtNew <= 0 || dtNew == dtTotal) {
+		return;
+	}
+	Ticks dt = tNow - tStart;
+	if (0 < dt && dt < dtTotal) {
+		// a slower rate soon after power up can move tStart before tick 0
+		tStart = tNow - (Ticks)((float) dt * dtNew / dtTotal);
+		if (tStart == 0) {
+			tStart = -1; // zero means not started
+		}
+	}
+	dtTotal = dtNew;
 }
 
 void Stroke::clear() {
 	length = 0;
 	maxEndPulses = 16;
 	scale = 1;
+	order = 1;
 	curSeg = 0;
 	tStart = 0;
 	dtTotal = 0;
+	dtPlanned = 0;
 	dPos = dEndPos = Quad<StepCoord>();
+	aSeg = vSeg = posSeg = Quad<StepCoord>();
+	ddaSeg = 0;
+	ddaSlice = 0;
+	dda = false;
 	vPeak = 0;
+	dPosMin = dPosMax = Quad<StepCoord>();
+	travelChecked = false;
 }
 
 SegIndex Stroke::goalSegment(Ticks t) {
@@ -96,16 +135,80 @@ Quad<StepCoord> Stroke::goalPos(Ticks t) {
 	} else {
 		dt = min(dtTotal, dt);
 		Ticks tNum = (dt>dtSegEnd ? dtSegEnd:dt) - dtSegStart;
+#ifdef STROKE_POSITION_TABLE
+		for (QuadIndex iMotor=0; iMotor<QUAD_ELEMENTS; iMotor++) {
+			StepCoord pos = sGoal ? segPos[sGoal-1].value[iMotor] : 0;
+			StepCoord v = segPos[sGoal].value[iMotor] - pos; // segment velocity
+			dGoal.value[iMotor] = pos + (tNum * (int32_t)v) / dtSeg;
+		}
+#else
 		for (QuadIndex iMotor=0; iMotor<QUAD_ELEMENTS; iMotor++) {
+			StepCoord a = 0; // segment acceleration
 			StepCoord v = 0; // segment velocity
 			StepCoord pos = 0;
 			for (SegIndex s=0; s<sGoal; s++) {
-				v += scale * (StepCoord) seg[s].value[iMotor];
+				StepCoord dv = scale * (StepCoord) seg[s].value[iMotor];
+				if (order == 2) {
+					a += dv;
+					dv = a;
+				}
+				v += dv;
 				pos += v;
 			}
-			v += scale * (StepCoord) seg[sGoal].value[iMotor];
+			StepCoord dv = scale * (StepCoord) seg[sGoal].value[iMotor];
+			if (order == 2) {
+				dv += a;
+			}
+			v += dv;
 			dGoal.value[iMotor] = pos + (tNum * (int32_t)v) / dtSeg;
 		}
+#endif
+	}
+	return dGoal;
+}
+
+/**
+ * Return the same value as goalPos(t) in constant time for non-decreasing t.
+ * Segment velocity and position are accumulated in vSeg and posSeg,
+ * which only advance when curSeg crosses a segment boundary.
+ */
+Quad<StepCoord> Stroke::goalPosIncremental(Ticks t) {
+	SegIndex sGoal = goalSegment(t);
+	Quad<StepCoord> dGoal;
+	Ticks dtSegStart = goalStartTicks(t);
+	Ticks dtSegEnd = goalEndTicks(t);
+	Ticks dtSeg = dtSegEnd - dtSegStart;
+	Ticks dt = t - tStart;
+	if (dt <= 0 || dtTotal <= 0 || length <= 0 || dtSeg <= 0) {
+		// do nothing
+	} else if (dtTotal <= dt && !dEndPos.isZero()) {
+		dGoal = dEndPos;
+	} else {
+		if (sGoal < curSeg) { // time went backwards
+			curSeg = 0;
+			aSeg = vSeg = posSeg = Quad<StepCoord>();
+		}
+		for (; curSeg < sGoal; curSeg++) {
+			for (QuadIndex iMotor=0; iMotor<QUAD_ELEMENTS; iMotor++) {
+				StepCoord dv = scale * (StepCoord) seg[curSeg].value[iMotor];
+				if (order == 2) {
+					aSeg.value[iMotor] += dv;
+					dv = aSeg.value[iMotor];
+				}
+				vSeg.value[iMotor] += dv;
+				posSeg.value[iMotor] += vSeg.value[iMotor];
+			}
+		}
+		dt = min(dtTotal, dt);
+		Ticks tNum = (dt>dtSegEnd ? dtSegEnd:dt) - dtSegStart;
+		for (QuadIndex iMotor=0; iMotor<QUAD_ELEMENTS; iMotor++) {
+			StepCoord dv = scale * (StepCoord) seg[sGoal].value[iMotor];
+			if (order == 2) {
+				dv += aSeg.value[iMotor];
+			}
+			StepCoord v = vSeg.value[iMotor] + dv;
+			dGoal.value[iMotor] = posSeg.value[iMotor] + (tNum * (int32_t)v) / dtSeg;
+		}
 	}
 	return dGoal;
 }
@@ -122,9 +225,41 @@ Status Stroke::start(Ticks tStart) {
     }
 
     dPos = 0;
-    if (dEndPos.isZero()) {
+	curSeg = 0;
+	ddaSeg = 0;
+	ddaSlice = 0;
+	aSeg = vSeg = posSeg = Quad<StepCoord>();
+	travelChecked = false;
+	dPosMin = dPosMax = Quad<StepCoord>();
+	Quad<StepCoord> a;
+	Quad<StepCoord> v;
+	Quad<StepCoord> pos;
+	for (SegIndex s=0; s<length; s++) {
+		for (QuadIndex iMotor=0; iMotor<QUAD_ELEMENTS; iMotor++) {
+			StepCoord dv = scale * (StepCoord) seg[s].value[iMotor];
+			if (order == 2) {
+				a.value[iMotor] += dv;
+				dv = a.value[iMotor];
+			}
+			v.value[iMotor] += dv;
+			pos.value[iMotor] += v.value[iMotor];
+			// goalPos() interpolates between segment ends, so these are the extremes
+			dPosMin.value[iMotor] = min(dPosMin.value[iMotor], pos.value[iMotor]);
+			dPosMax.value[iMotor] = max(dPosMax.value[iMotor], pos.value[iMotor]);
+		}
+#ifdef STROKE_POSITION_TABLE
+		segPos[s] = pos;
+#endif
+	}
+    bool endGiven = !dEndPos.isZero();
+    if (!endGiven) {
 		dEndPos = goalPos(tStart + dtTotal);
-	} else {
+	}
+	for (QuadIndex iMotor=0; iMotor<QUAD_ELEMENTS; iMotor++) {
+		dPosMin.value[iMotor] = min(dPosMin.value[iMotor], dEndPos.value[iMotor]);
+		dPosMax.value[iMotor] = max(dPosMax.value[iMotor], dEndPos.value[iMotor]);
+	}
+	if (endGiven) {
         Quad<StepCoord> almostEnd = goalPos(tStart + dtTotal - 1);
         for (QuadIndex i = 0; i < 4; i++) {
             if (maxEndPulses < abs(dEndPos.value[i] - almostEnd.value[i])) {
@@ -144,9 +279,54 @@ bool Stroke::isDone() {
     return dPos == dEndPos;
 }
 
+#define PULSE_BLOCK 32 /* pulses emitted without limit checks */
+
+/**
+ * Emit dPosSeg pulses with ProtocolB in blocks of at most PULSE_BLOCK 
+ * pulses per axis, advancing dPos as pulses are emitted. Returns
+ * STATUS_BUSY if the stepper cannot take the next block yet.
+ */
+static Status stepBlocks(QuadStepper &stepper, Quad<StepCoord> &dPos, Quad<StepCoord> dPosSeg) {
+    Status status = STATUS_OK;
+	Quad<StepDV> pulse;
+	for (bool done=true; ; done=true) {
+		for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+			StepCoord dp = dPosSeg.value[i];
+			if (dp < -PULSE_BLOCK) {
+				pulse.value[i] = -PULSE_BLOCK;
+				done = false;
+			} else if (dp > PULSE_BLOCK) {
+				pulse.value[i] = PULSE_BLOCK;
+				done = false;
+			} else if (dp) {
+				pulse.value[i] = dp;
+				done = false;
+			} else {
+				pulse.value[i] = 0;
+			}
+			dPosSeg.value[i] -= (StepCoord) pulse.value[i];
+		}
+		if (done) {
+			break;
+		}
+		status = stepper.stepDirection(pulse);
+		if (status != STATUS_OK) {
+			return status;
+		}
+		dPos += pulse;
+		if (0 > (status = stepper.stepFast(pulse))) {
+			return status;
+		}
+	}
+	return status;
+}
+
 Status Stroke::traverse(Ticks tCurrent, QuadStepper &stepper) {
-    Quad<StepCoord> dGoal = goalPos(tCurrent);
-    if (tStart <= 0) {
+	if (dda) {
+		return traverseDDA(tCurrent, stepper);
+	}
+    Quad<StepCoord> dGoal = goalPosIncremental(tCurrent);
+    if (tStart == 0) {
         return STATUS_STROKE_START;
     }
 #ifdef TEST
@@ -185,39 +365,93 @@ Status Stroke::traverse(Ticks tCurrent, QuadStepper &stepper) {
         }
     }
 #else
-#define PULSE_BLOCK 32 /* pulses emitted without limit checks */
-	Quad<StepCoord> dPosSeg = dGoal - dPos;
-	for (bool done=true; ; done=true) {
-		for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-			StepCoord dp = dPosSeg.value[i];
-			if (dp < -PULSE_BLOCK) {
-				pulse.value[i] = -PULSE_BLOCK;
-				done = false;
-			} else if (dp > PULSE_BLOCK) {
-				pulse.value[i] = PULSE_BLOCK;
-				done = false;
-			} else if (dp) {
-				pulse.value[i] = dp;
-				done = false;
-			} else {
-				pulse.value[i] = 0;
+	if (0 > (status = stepBlocks(stepper, dPos, dGoal - dPos))) {
+		return status;
+	}
+	if (status == STATUS_BUSY) {
+		return STATUS_BUSY_MOVING; // stepper will take the rest on the next traverse()
+	}
+#endif
+	status = (tCurrent >= tStart + dtTotal) ? STATUS_OK : STATUS_BUSY_MOVING;
+    return status;
+}
+
+#define DDA_SLICE 16 /* maximum pulses per motor handed to stepSegment() at once */
+
+/**
+ * Traverse the stroke in slices handed to the stepper with ProtocolC.
+ * Each segment is split into slices of at most DDA_SLICE pulses per motor,
+ * and each slice is handed over at its start tick, so a stepper with timed
+ * emission spreads the pulses evenly instead of emitting them in bursts.
+ * Nothing waits: slices that are not due, or that the stepper cannot take
+ * yet, are handed over on a later traverse().
+ */
+Status Stroke::traverseDDA(Ticks tCurrent, QuadStepper &stepper) {
+    if (tStart == 0) {
+        return STATUS_STROKE_START;
+    }
+	Ticks dt = tCurrent - tStart;
+	while (ddaSeg < length) {
+		Ticks dtSegStart = ((int32_t) ddaSeg * dtTotal) / length;
+		Ticks dtSeg = ((int32_t) (ddaSeg + 1) * dtTotal) / length - dtSegStart;
+		Quad<StepCoord> dGoal = (ddaSeg + 1 < length) ? 
+			goalPosIncremental(tStart + dtSegStart + dtSeg) : dEndPos;
+		if (ddaSlice == 0) {
+			StepCoord n = 0;
+			for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+				n = max(n, (StepCoord) abs(dGoal.value[i] - dPos.value[i]));
 			}
-			dPosSeg.value[i] -= (StepCoord) pulse.value[i];
-			dPos.value[i] += (StepCoord) pulse.value[i];
+			ddaSlices = n ? (n + DDA_SLICE - 1) / DDA_SLICE : 1;
 		}
-		if (done) {
-			break;
+		Ticks dtSliceStart = dtSegStart + (dtSeg * ddaSlice) / ddaSlices;
+		if (dt < dtSliceStart) {
+			break; // slice has not started
 		}
-		if (0 > (status = stepper.stepDirection(pulse))) { 
-			return status;
+		Ticks dtSliceEnd = dtSegStart + (dtSeg * (ddaSlice + 1)) / ddaSlices;
+		Quad<StepCoord> dSlice;
+		for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+			dSlice.value[i] = (dGoal.value[i] - dPos.value[i]) / (ddaSlices - ddaSlice);
 		}
-		if (0 > (status = stepper.stepFast(pulse))) {
+		Status status = stepper.stepSegment(dSlice, dtSliceEnd - dtSliceStart);
+		if (status == STATUS_BUSY) {
+			return STATUS_BUSY_MOVING;
+		}
+		if (status < 0) {
 			return status;
 		}
+		dPos += dSlice;
+		if (++ddaSlice >= ddaSlices) {
+			ddaSlice = 0;
+			ddaSeg++;
+		}
 	}
-#endif
-	status = (tCurrent >= tStart + dtTotal) ? STATUS_OK : STATUS_BUSY_MOVING;
-    return status;
+	if (ddaSeg < length || dt < dtTotal) {
+		return STATUS_BUSY_MOVING;
+	}
+	curSeg = length;
+	return STATUS_OK;
+}
+
+/**
+ * ProtocolC: this default implementation has no timer to spread the
+ * pulses over the segment duration, so it emits the segment at once
+ * with ProtocolB. Segments are short (see traverseDDA()), but evenly
+ * spaced pulses need a timed stepper such as StepEngine, which is why
+ * JsonController only accepts dda strokes with STEP_ENGINE.
+ */
+Status QuadStepper::stepSegment(const Quad<StepCoord> &dPos, Ticks) {
+	Quad<StepDV> pulse;
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+		if (dPos.value[i] < -127 || 127 < dPos.value[i]) {
+			return STATUS_STEP_RANGE_ERROR;
+		}
+		pulse.value[i] = dPos.value[i];
+	}
+	Status status = stepDirection(pulse);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	return stepFast(pulse);
 }
 
 int16_t Stroke::append(Quad<StepDV> dv) {
@@ -229,80 +463,715 @@ int16_t Stroke::append(Quad<StepDV> dv) {
     return length;
 }
 
+/**
+ * Convert seg[] to the given order before start() without changing the
+ * traversal. Order 2 segments are the differences of order 1 segments,
+ * which are small for smooth profiles and need fewer characters in dvs
+ * arrays. Returns STATUS_STROKE_SEGPULSES and leaves the stroke unchanged
+ * if a converted segment does not fit StepDV.
+ */
+Status Stroke::setOrder(uint8_t newOrder) {
+	if (newOrder < 1 || 2 < newOrder) {
+		return STATUS_FIELD_RANGE_ERROR;
+	}
+	if (newOrder == order) {
+		return STATUS_OK;
+	}
+	for (uint8_t pass = 0; pass < 2; pass++) { // check, then convert
+		for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+			StepCoord prev = 0; // previous order 1 segment
+			for (SegIndex s = 0; s < length; s++) {
+				StepCoord dv = seg[s].value[i];
+				StepCoord dvNew = (newOrder == 2) ? dv - prev : dv + prev;
+				if (dvNew < -127 || 127 < dvNew) {
+					return STATUS_STROKE_SEGPULSES;
+				}
+				prev = (newOrder == 2) ? dv : dvNew;
+				if (pass) {
+					seg[s].value[i] = dvNew;
+				}
+			}
+		}
+	}
+	order = newOrder;
+	return STATUS_OK;
+}
+
 /////////////////// StrokeBuilder ////////////////
 
 StrokeBuilder::StrokeBuilder(int32_t vMax, float vMaxSeconds,
-                             int16_t minSegments, int16_t maxSegments)
+                             int16_t minSegments, int16_t maxSegments, StepCoord maxDeviation)
     : vMax(vMax), vMaxSeconds(vMaxSeconds),
-      minSegments(minSegments), maxSegments(maxSegments) {
+      minSegments(minSegments), maxSegments(maxSegments), maxDeviation(maxDeviation) {
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+		motorVMax[i] = 0;
+	}
 	if (maxSegments == 0 || SEGMENT_COUNT <= maxSegments) {
 		maxSegments = SEGMENT_COUNT-1;
 	}
 }
 
-/**
- * Build a rest-to-rest stroke with minimum jerk that continuously accelerates
- * until it reaches the end position located at relPos from current position
- * in the fastest possible time subject to the minimum jerk constraint
- */
-Status StrokeBuilder::buildLine(Stroke & stroke, Quad<StepCoord> relPos) {
-    PH5TYPE K[QUAD_ELEMENTS];
-    PH5TYPE Ksqrt[QUAD_ELEMENTS];
+#define Z6400 56.568542495
+
+static StepCoord dominantPulses(const Quad<StepCoord> &relPos) {
 	StepCoord pulses = 0;
     for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-        K[i] = relPos.value[i] / 6400.0;
-		TESTCOUT2("K[", i, "]:", K[i]);
-		Ksqrt[i] = sqrt(abs(K[i]));
-		pulses = max(abs(relPos.value[i]), pulses);
+		pulses = max((StepCoord) abs(relPos.value[i]), pulses);
     }
-	TESTCOUT1("buildLine:", relPos.toString());
-#define Z6400 56.568542495
-    PHVECTOR<Complex<PH5TYPE> > z[QUAD_ELEMENTS];
-    PHVECTOR<Complex<PH5TYPE> > q[QUAD_ELEMENTS];
-    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-		z[i].push_back(Complex<PH5TYPE>());
-		if (K[i] < 0) {
-			z[i].push_back(Complex<PH5TYPE>(0,Z6400 * Ksqrt[i]));
-			z[i].push_back(Complex<PH5TYPE>(0,Z6400 * Ksqrt[i]));
-		} else {
-			z[i].push_back(Complex<PH5TYPE>(Z6400 * Ksqrt[i]));
-			z[i].push_back(Complex<PH5TYPE>(Z6400 * Ksqrt[i]));
+	return pulses;
+}
+
+/**
+ * Return the dominant axis velocity limit for a line to the given offset.
+ * All motors follow the same travel profile, so the line is limited by the
+ * motor that would exceed its own motorVMax (or vMax) first.
+ */
+int32_t StrokeBuilder::lineVMax(const Quad<StepCoord> &relPos) {
+	StepCoord pulses = dominantPulses(relPos);
+	float v = vMax;
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+		if (motorVMax[i] > 0 && motorVMax[i] < vMax && relPos.value[i]) {
+			v = min(v, motorVMax[i] * (float) pulses / abs(relPos.value[i]));
 		}
-        q[i].push_back(Complex<PH5TYPE>());
-        q[i].push_back(Complex<PH5TYPE>(3200 * K[i]));
-        q[i].push_back(Complex<PH5TYPE>(6400 * K[i]));
-    }
-    PH5Curve<PH5TYPE> ph[] = {
-        PH5Curve<PH5TYPE>(z[0], q[0]),
-        PH5Curve<PH5TYPE>(z[1], q[1]),
-        PH5Curve<PH5TYPE>(z[2], q[2]),
-        PH5Curve<PH5TYPE>(z[3], q[3])
-    };
-	TESTCOUT2("ph[0].r(0.5).Re:", ph[0].r(0.5).Re(), " Im:", ph[0].r(0.5).Im());
-	TESTCOUT2("ph[0].r(1).Re:", ph[0].r(1).Re(), " Im:", ph[0].r(1).Im());
-	TESTCOUT2("ph vMax:", vMax, " vMaxSeconds:", vMaxSeconds);
-
-    PHFeed<PH5TYPE> phf[] = {
-        PHFeed<PH5TYPE>(ph[0], vMax, vMaxSeconds),
-        PHFeed<PH5TYPE>(ph[1], vMax, vMaxSeconds),
-        PHFeed<PH5TYPE>(ph[2], vMax, vMaxSeconds),
-        PHFeed<PH5TYPE>(ph[3], vMax, vMaxSeconds)
-    };
-    PH5TYPE tS = 0;
-    QuadIndex iMax = 0;
-    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-		PH5TYPE tSi = phf[i].get_tS();
-        if (K[i] != 0) { // active axis
-			TESTCOUT3("phf[", i, "] s(1):", phf[0].s(1), " tS:", tSi);
-			if (K[i] != 0 && tSi > tS) {
-				iMax = i;
-				tS = tSi;
+	}
+	return v;
+}
+
+static PHVECTOR<Complex<PH5TYPE> > lineZ(StepCoord pulses) {
+    PHVECTOR<Complex<PH5TYPE> > z;
+	z.push_back(Complex<PH5TYPE>());
+	z.push_back(Complex<PH5TYPE>(Z6400 * sqrt(pulses / 6400.0)));
+	z.push_back(Complex<PH5TYPE>(Z6400 * sqrt(pulses / 6400.0)));
+	return z;
+}
+
+static PHVECTOR<Complex<PH5TYPE> > lineQ(StepCoord pulses) {
+    PHVECTOR<Complex<PH5TYPE> > q;
+	q.push_back(Complex<PH5TYPE>());
+	q.push_back(Complex<PH5TYPE>(pulses / 2.0));
+	q.push_back(Complex<PH5TYPE>(pulses));
+	return q;
+}
+
+/////////////////// PH5FixedLine ////////////////
+
+/**
+ * Capture the PH5 line curve as the quintic polynomial of the travel
+ * fraction r(E)/pulses. The polynomial is recovered from six float
+ * evaluations by forward differences and expanded to monomial form.
+ */
+PH5FixedLine::PH5FixedLine(PH5Curve<PH5TYPE> &ph, StepCoord pulses) {
+	PH5TYPE d[6];	// forward differences at E = 0, 0.2, ... 1
+	PH5TYPE p[6];	// polynomial coefficients in E
+	for (int8_t j = 0; j < 6; j++) {
+		d[j] = pulses ? ph.r(j / (PH5TYPE) 5).Re() / pulses : 0;
+		p[j] = 0;
+	}
+	for (int8_t k = 1; k < 6; k++) {
+		for (int8_t j = 5; j >= k; j--) {
+			d[j] -= d[j - 1];
+		}
+	}
+	// Newton form f(E) = d0 + x(d1 + (x-1)/2 (d2 + ...)) with x = 5E
+	p[0] = d[5];
+	for (int8_t k = 4; k >= 0; k--) {
+		for (int8_t j = 5; j > 0; j--) { // p *= (5E - k)/(k+1)
+			p[j] = (5 * p[j - 1] - k * p[j]) / (k + 1);
+		}
+		p[0] = -k * p[0] / (k + 1) + d[k];
+	}
+	for (int8_t j = 0; j < 6; j++) {
+		c[j] = p[j] * PH5FIXED_ONE + (p[j] < 0 ? -0.5 : 0.5);
+	}
+}
+
+/**
+ * Return travel fraction at curve parameter E in [0,1].
+ * Products are split at bit 16 so that no partial product exceeds 32 bits.
+ */
+PH5Fixed PH5FixedLine::fraction(PH5TYPE E) {
+	uint32_t e = E <= 0 ? 0 : (E >= 1 ? 1L << PH5FIXED_EBITS : ldexp(E, PH5FIXED_EBITS)); // Q0.16
+	PH5Fixed f = c[5];
+	for (int8_t j = 4; j >= 0; j--) {
+		f = (f >> 16) * (int32_t) e + (PH5Fixed) (((uint32_t) (f & 0xffff) * e) >> 16) + c[j];
+	}
+	return f;
+}
+
+/**
+ * Return travel fraction f of the given pulses rounded to nearest pulse
+ */
+StepCoord PH5FixedLine::travel(PH5Fixed f, StepCoord pulses) {
+	int32_t p = pulses < 0 ? -(int32_t) pulses : pulses;
+	int32_t pos = (f >> 16) * p + (((f & 0xffff) * p) >> 16); // Q8 pulses
+	pos = (pos + (1 << (PH5FIXED_BITS - 17))) >> (PH5FIXED_BITS - 16);
+	return pulses < 0 ? -pos : pos;
+}
+
+/////////////////// PH5Line ////////////////
+
+PH5Line::PH5Line(const Quad<StepCoord> &relPos)
+	: pulses(dominantPulses(relPos)),
+	  ph(lineZ(pulses), lineQ(pulses)),
+#ifdef PH5_FIXED
+	  fixedLine(ph, pulses),
+#endif
+	  dEndPos(relPos) {
+}
+
+/**
+ * Return travel fraction at curve parameter E
+ */
+PH5TYPE PH5Line::fraction(PH5TYPE E) {
+	return pulses ? ph.r(E).Re() / pulses : 0;
+}
+
+/**
+ * Set pos to the motor offsets at curve parameter E rounded to nearest pulse
+ */
+void PH5Line::position(Quad<StepCoord> &pos, PH5TYPE E) {
+#ifdef PH5_FIXED
+	PH5Fixed f = fixedLine.fraction(E);
+#else
+	PH5TYPE f = fraction(E);
+#endif
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+#ifdef PH5_FIXED
+		pos.value[i] = PH5FixedLine::travel(f, dEndPos.value[i]);
+#else
+		PH5TYPE p = f * dEndPos.value[i];
+		pos.value[i] = p < 0 ? p-0.5 : p+0.5;
+#endif
+	}
+}
+
+/**
+ * Rest-to-rest PH5 line to a motor offset. Positions are evaluated by
+ * pathSegments() at increasing traversal time fractions.
+ */
+class LinePath : public PH5Line {
+    private:
+        LinePath(const LinePath &that); // not copyable (phf refers to ph)
+    public:
+        PHFeed<PH5TYPE>		phf;		// feed of dominant axis
+        PH5TYPE				E;			// curve parameter of last position
+    public:
+        LinePath(const Quad<StepCoord> &relPos, int32_t vMax, float vMaxSeconds)
+            : PH5Line(relPos), phf(ph, vMax, vMaxSeconds), E(0) {
+        }
+        PH5TYPE get_tS() {
+            return phf.get_tS();
+        }
+        void start() {
+            E = phf.Ekt(0, 0);
+        }
+        PH5TYPE fraction(PH5TYPE tau) {
+            E = phf.Ekt(E, tau);
+            return PH5Line::fraction(E);
+        }
+        Status position(Quad<StepCoord> &pos, PH5TYPE tau) {
+            E = phf.Ekt(E, tau);
+            PH5Line::position(pos, E);
+            return STATUS_OK;
+        }
+};
+
+/**
+ * Build N uniform segments of the given path into the stroke using the
+ * smallest segment scale that fits StepDV. Scaled segment velocities are
+ * rounded so that each segment ends within scale/2 pulses of the path,
+ * and dEndPos is set to correct the final offset. If deviation is not NULL,
+ * it is set to the largest pulse difference at any segment midpoint or end
+ * between the interpolated segment positions and the path.
+ */
+template<class P> static Status pathSegments(Stroke &stroke, P &path, int16_t N, StepCoord *deviation) {
+	StepCoord scale = 1;
+	StepCoord dvOverflow = 0;
+	do {
+		if (dvOverflow) {
+			scale = max((StepCoord)(scale + 1), (StepCoord)((dvOverflow + 126) / 127));
+			dvOverflow = 0;
+		}
+		stroke.clear();
+		if (2 * stroke.maxEndPulses < scale) {
+			return STATUS_STROKE_SEGPULSES; // end correction would be too large
+		}
+		Quad<StepCoord> s;
+		Quad<StepCoord> v;
+		Quad<StepCoord> sNew;
+		Quad<StepCoord> sMid;
+		Quad<StepDV> segment;
+		Status status;
+		path.start();
+		if (deviation) {
+			*deviation = 0;
+		}
+		for (int16_t iSeg = 1; !dvOverflow && iSeg <= N; iSeg++) {
+			if (deviation) {
+				status = path.position(sMid, (iSeg - 0.5) / N);
+				if (status != STATUS_OK) {
+					return status;
+				}
+			}
+			status = path.position(sNew, iSeg / (PH5TYPE)N);
+			if (status != STATUS_OK) {
+				return status;
 			}
+			for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+				StepCoord dv = sNew.value[i] - s.value[i] - v.value[i];
+				if (dv < (StepCoord) -127 * scale || (StepCoord) 127 * scale < dv) {
+					dvOverflow = max(dvOverflow, (StepCoord) abs(dv));
+					continue;
+				}
+				dv = (dv < 0 ? dv - scale/2 : dv + scale/2) / scale; // nearest scale unit
+				dv = max((StepCoord)-127, min((StepCoord)127, dv));
+				segment.value[i] = dv;
+				v.value[i] += scale * dv;
+				stroke.vPeak = max(stroke.vPeak, (int32_t)abs(v.value[i]));
+				StepCoord sPrev = s.value[i];
+				s.value[i] += v.value[i];
+				if (deviation) {
+					StepCoord d = abs(2*sMid.value[i] - sPrev - s.value[i]) / 2;
+					d = max(d, (StepCoord) abs(sNew.value[i] - s.value[i]));
+					*deviation = max(*deviation, d);
+				}
+			}
+			if (!dvOverflow) {
+				int16_t rc = stroke.append(segment);
+				if (rc < 0) {
+					return (Status) rc;
+				}
+			}
+		}
+	} while (dvOverflow);
+	if (scale != 1) {
+		stroke.scale = scale;
+		stroke.dEndPos = path.dEndPos;
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Build the given path into the stroke. If maxDeviation is zero, the segment
+ * count is fixed by segmentCount(). Otherwise, the segment count is the
+ * smallest one from minSegments to maxSegments whose segments stay within
+ * maxDeviation pulses of the path, or STATUS_STROKE_DEVIATION if there is
+ * none. Segment rounding makes the deviation go up and down as segments
+ * are added, so the counts are tried in turn rather than bisected.
+ * Deviation is only measured at segment midpoints and ends, which a single
+ * segment of a symmetric line always meets, so minSegments should be a few.
+ * Segments that overflow StepDV are scaled (see pathSegments()).
+ */
+template<class P> static Status pathStroke(StrokeBuilder &sb, Stroke &stroke, P &path) {
+	PH5TYPE tS = path.get_tS();
+	Status status;
+	int16_t N;
+	if (sb.maxDeviation <= 0) {
+		N = sb.segmentCount(tS, path.pulses, SEGMENT_COUNT-1);
+		status = pathSegments(stroke, path, N, (StepCoord *) NULL);
+	} else {
+		int16_t nHi = min(sb.maxSegments, (int16_t)(SEGMENT_COUNT-1));
+		StepCoord deviation = 0;
+		status = STATUS_STROKE_NULL_ERROR;
+		for (N = min(nHi, max((int16_t) 1, sb.minSegments)); N <= nHi; N++) {
+			status = pathSegments(stroke, path, N, &deviation);
+			if (status == STATUS_OK && deviation <= sb.maxDeviation) {
+				break;
+			}
+			if (status != STATUS_OK && status != STATUS_STROKE_SEGPULSES) {
+				break; // more segments will not help
+			}
+		}
+		if (N > nHi) {
+			N = nHi;
+			if (status == STATUS_OK) {
+				TESTCOUT2(" pathStroke N:", N, " deviation:", deviation);
+				return STATUS_STROKE_DEVIATION;
+			}
+		}
+	}
+	if (status != STATUS_OK) {
+		TESTCOUT2(" pathStroke N:", N, " status:", status);
+		return status;
+	}
+    TESTCOUT3(" N:", N, " tS:", tS, " dEndPos:", stroke.dEndPos.toString());
+    stroke.setTimePlanned(tS);
+
+    return STATUS_OK;
+}
+
+/**
+ * Build a rest-to-rest PH5 line to the given offset (see pathStroke())
+ */
+Status StrokeBuilder::buildLine(Stroke & stroke, Quad<StepCoord> relPos) {
+	LinePath path(relPos, lineVMax(relPos), vMaxSeconds);
+	return pathStroke(*this, stroke, path);
+}
+
+#define DELTA_GAIN_SAMPLES 8 /* IK samples used to estimate the peak motor rate of a delta line */
+
+/**
+ * Straight Cartesian PH5 line of a delta robot. Each position is the
+ * motor offset from the start position given by inverse kinematics.
+ */
+class DeltaPath {
+    private:
+        DeltaPath(const DeltaPath &that); // not copyable
+    public:
+        DeltaCalculator		&delta;
+        XYZ					xyz1;		// start position
+        XYZ					dxyz;		// Cartesian offset
+        Quad<StepCoord>		pulses1;	// motor position at start
+        Quad<StepCoord>		dEndPos;	// ending offset
+        StepCoord			pulses;		// travel of dominant axis of line
+        LinePath			*pLine;		// travel fraction
+    public:
+        DeltaPath(DeltaCalculator &delta, const XYZ &xyz1, const XYZ &xyz2)
+            : delta(delta), xyz1(xyz1),
+              dxyz(xyz2.x - xyz1.x, xyz2.y - xyz1.y, xyz2.z - xyz1.z),
+              pulses(0), pLine(NULL) {
         }
-    }
-    stroke.clear();
-    PH5TYPE E = 0;
+        Status calcPulses(Quad<StepCoord> &pos, PH5TYPE f) {
+            XYZ xyz(xyz1.x + f * dxyz.x, xyz1.y + f * dxyz.y, xyz1.z + f * dxyz.z);
+            Status status = delta.calcPulses(xyz, pos);
+            pos -= pulses1;
+            return status;
+        }
+        /**
+         * Set gain to the peak motor pulses per unit of travel fraction
+         */
+        Status calcGain(Quad<StepCoord> &gain) {
+            Status status = delta.calcPulses(xyz1, pulses1);
+            Quad<StepCoord> posPrev;
+            for (int16_t k = 1; status == STATUS_OK && k <= DELTA_GAIN_SAMPLES; k++) {
+                Quad<StepCoord> pos;
+                status = calcPulses(pos, k / (PH5TYPE) DELTA_GAIN_SAMPLES);
+                for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+                    int32_t g = (int32_t) abs(pos.value[i] - posPrev.value[i]) * DELTA_GAIN_SAMPLES;
+                    gain.value[i] = max((int32_t)gain.value[i], min((int32_t)0x7fff, g));
+                }
+                posPrev = pos;
+            }
+            dEndPos = posPrev;
+            return status;
+        }
+        PH5TYPE get_tS() {
+            return pLine->get_tS();
+        }
+        void start() {
+            pLine->start();
+        }
+        Status position(Quad<StepCoord> &pos, PH5TYPE tau) {
+            PH5TYPE f = pLine->fraction(tau);
+            if (tau >= 1) {
+                pos = dEndPos;
+                return STATUS_OK;
+            }
+            return calcPulses(pos, f);
+        }
+};
+
+/**
+ * Build a rest-to-rest straight Cartesian line between the given positions
+ * of a delta robot. The Cartesian travel follows a PH5 line and each segment
+ * end is converted to motor pulses by inverse kinematics, so the stroke is
+ * relative to the motor position of xyz1. Motor velocity is limited by
+ * the peak motor rate along the line (see lineVMax()).
+ * Delta lines are planned on the host (plan -k), since the firmware has no
+ * forward kinematics to know the Cartesian start position.
+ */
+Status StrokeBuilder::buildDeltaLine(Stroke & stroke, DeltaCalculator &delta,
+                                     const XYZ &xyz1, const XYZ &xyz2) {
+	DeltaPath path(delta, xyz1, xyz2);
+	Quad<StepCoord> gain;
+	Status status = path.calcGain(gain);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	LinePath line(gain, lineVMax(gain), vMaxSeconds);
+	path.pulses = line.pulses;
+	path.pLine = &line;
+	return pathStroke(*this, stroke, path);
+}
+
+#define CORDIC_ITERATIONS 16 /* rotation error is within atan(2^-15) radians */
+#define CORDIC_GAIN 39797 /* 2^16 / CORDIC gain of CORDIC_ITERATIONS iterations */
+#define CORDIC_BITS 8 /* fraction bits of rotated coordinates */
+
+typedef uint32_t BinaryAngle;	// angle in units of 1/2^32 turn
+
+static const int32_t cordicAtan[CORDIC_ITERATIONS] = { // atan(2^-i) as BinaryAngle
+	536870912, 316933406, 167458907, 85004756, 42667331, 21354465, 10679838, 5340245,
+	2670163, 1335087, 667544, 333772, 166886, 83443, 41722, 20861,
+};
 
+/**
+ * Rotate the fixed point vector (x,y) by the given angle with shift-and-add
+ * CORDIC iterations. The vector must already be scaled by 1/CORDIC gain.
+ */
+static void cordicRotate(int32_t &x, int32_t &y, BinaryAngle angle) {
+	// rotate by whole quarter turns so that the remaining angle is within 1/8 turn
+	uint8_t quadrant = (angle + 0x20000000UL) >> 30;
+	int32_t z = (int32_t) (angle - ((BinaryAngle) quadrant << 30));
+	int32_t t = x;
+	switch (quadrant) {
+	case 1:
+		x = -y;
+		y = t;
+		break;
+	case 2:
+		x = -x;
+		y = -y;
+		break;
+	case 3:
+		x = y;
+		y = -t;
+		break;
+	}
+	for (uint8_t i = 0; i < CORDIC_ITERATIONS; i++) {
+		int32_t dx = y >> i;
+		int32_t dy = x >> i;
+		if (z >= 0) {
+			x -= dx;
+			y += dy;
+			z -= cordicAtan[i];
+		} else {
+			x += dx;
+			y -= dy;
+			z += cordicAtan[i];
+		}
+	}
+}
+
+/**
+ * Circular arc about a center in the plane of motors 0 and 1, optionally
+ * with helical travel that advances in proportion to the arc.
+ */
+class ArcPath {
+    private:
+        ArcPath(const ArcPath &that); // not copyable
+    public:
+        Quad<StepCoord>		center;		// arc center offset
+        PH5TYPE				sweep;		// arc angle (radians, positive is motor 0 to motor 1)
+        Quad<StepCoord>		helix;		// helical travel offset
+        int32_t				xStart;		// start radius of motor 0 (CORDIC fixed point)
+        int32_t				yStart;		// start radius of motor 1 (CORDIC fixed point)
+        Quad<StepCoord>		dEndPos;	// ending offset
+        StepCoord			pulses;		// travel of dominant axis of line
+        LinePath			*pLine;		// travel fraction
+    public:
+        ArcPath(const Quad<StepCoord> &center, PH5TYPE sweep, const Quad<StepCoord> &helix)
+            : center(center), sweep(sweep), helix(helix),
+              xStart(((int32_t) -center.value[0] * CORDIC_GAIN) >> (16 - CORDIC_BITS)),
+              yStart(((int32_t) -center.value[1] * CORDIC_GAIN) >> (16 - CORDIC_BITS)),
+              pulses(0), pLine(NULL) {
+            arcPosition(dEndPos, 1);
+        }
+        void arcPosition(Quad<StepCoord> &pos, PH5TYPE f) {
+            PH5TYPE turns = f * sweep / (2 * M_PI);
+            turns -= floor(turns);
+            PH5TYPE a16 = turns * 65536.0;
+            BinaryAngle hi = min((PH5TYPE) 65535, a16);
+            BinaryAngle lo = min((PH5TYPE) 65535, (a16 - hi) * (PH5TYPE) 65536.0);
+            int32_t x = xStart;
+            int32_t y = yStart;
+            cordicRotate(x, y, (hi << 16) | lo);
+            pos.value[0] = center.value[0] + ((x + (1 << (CORDIC_BITS-1))) >> CORDIC_BITS);
+            pos.value[1] = center.value[1] + ((y + (1 << (CORDIC_BITS-1))) >> CORDIC_BITS);
+            pos.value[2] = pos.value[3] = 0;
+            for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+                PH5TYPE h = f * helix.value[i];
+                pos.value[i] += (StepCoord) (h < 0 ? h-0.5 : h+0.5);
+            }
+        }
+        PH5TYPE get_tS() {
+            return pLine->get_tS();
+        }
+        void start() {
+            pLine->start();
+        }
+        Status position(Quad<StepCoord> &pos, PH5TYPE tau) {
+            PH5TYPE f = pLine->fraction(tau);
+            if (tau >= 1) {
+                pos = dEndPos;
+            } else {
+                arcPosition(pos, f);
+            }
+            return STATUS_OK;
+        }
+};
+
+/**
+ * Build a rest-to-rest circular arc or helix. The arc turns the current
+ * position of motors 0 and 1 about the given center offset by the given
+ * sweep angle (radians). Helix travel is added in proportion to the arc.
+ * The travel fraction follows a PH5 line along the arc length, so the
+ * tangential feed is constant between the PH5 acceleration and
+ * deceleration ramps. Arc positions are rotated with integer CORDIC.
+ * Arcs are library-only: there is no JSON command for them, so host
+ * programs build them with the strokeplan library and send dvs strokes.
+ */
+Status StrokeBuilder::buildArc(Stroke & stroke, Quad<StepCoord> center, PH5TYPE sweep,
+                               Quad<StepCoord> helix) {
+	PH5TYPE radius = sqrt((PH5TYPE) center.value[0] * center.value[0] +
+	                      (PH5TYPE) center.value[1] * center.value[1]);
+	PH5TYPE arc = abs(sweep) * radius;
+	Quad<StepCoord> gain;
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+		PH5TYPE g = (i < 2 ? arc : 0) + abs(helix.value[i]);
+		if (g > 32767) {
+			return STATUS_VALUE_RANGE;
+		}
+		gain.value[i] = g + 0.5;
+	}
+	if (gain.isZero()) {
+		return STATUS_STROKE_NULL_ERROR;
+	}
+	ArcPath path(center, sweep, helix);
+	LinePath line(gain, lineVMax(gain), vMaxSeconds);
+	path.pulses = line.pulses;
+	path.pLine = &line;
+	return pathStroke(*this, stroke, path);
+}
+
+#define POLYLINE_LEGS 16 /* maximum number of polyline waypoints */
+
+/**
+ * Return travel fraction of a rest-to-rest quintic (minimum jerk) leg at
+ * the given leg time fraction
+ */
+static PH5TYPE legFraction(PH5TYPE tau) {
+	if (tau <= 0) {
+		return 0;
+	}
+	if (tau >= 1) {
+		return 1;
+	}
+	return tau * tau * tau * (10 + tau * (-15 + tau * 6));
+}
+
+/**
+ * Overlapping rest-to-rest quintic legs of a polyline. Positions are
+ * evaluated by pathSegments() at increasing traversal time fractions.
+ */
+class PolylinePath {
+    private:
+        PolylinePath(const PolylinePath &that); // not copyable
+    public:
+        Quad<StepCoord>		dLeg[POLYLINE_LEGS];	// leg offset
+        PH5TYPE				tLeg[POLYLINE_LEGS];	// leg start time
+        PH5TYPE				dtLeg[POLYLINE_LEGS];	// leg duration
+        int16_t				nLegs;
+        PH5TYPE				tS;						// traversal time
+        Quad<StepCoord>		dEndPos;				// ending offset
+    public:
+        PolylinePath() : nLegs(0), tS(0) {
+        }
+        void start() {
+        }
+        Status position(Quad<StepCoord> &pos, PH5TYPE tau) {
+            if (tau >= 1) {
+                pos = dEndPos;
+                return STATUS_OK;
+            }
+            PH5TYPE t = tau * tS;
+            for (QuadIndex j = 0; j < QUAD_ELEMENTS; j++) {
+                PH5TYPE p = 0;
+                for (int16_t iLeg = 0; iLeg < nLegs; iLeg++) {
+                    p += dLeg[iLeg].value[j] * legFraction((t - tLeg[iLeg]) / dtLeg[iLeg]);
+                }
+                pos.value[j] = p < 0 ? p-0.5 : p+0.5;
+            }
+            return STATUS_OK;
+        }
+};
+
+/**
+ * Build a single stroke through the given waypoints, which are positions
+ * relative to the current position. Each leg is a rest-to-rest quintic
+ * profile and each leg starts before its predecessor ends, overlapping by
+ * the blend fraction (0..1) of the shorter leg. The overlapping profiles
+ * sum to a smooth corner, so the stroke does not stop at intermediate
+ * waypoints unless the path reverses. The planned time is stretched if
+ * needed so that no motor exceeds its motorVMax (or vMax).
+ * Segments that overflow StepDV are scaled (see pathSegments()).
+ * There is no JSON command for polylines; the host plan tool builds them
+ * with -p and sends the result as dvs strokes.
+ */
+Status StrokeBuilder::buildPolyline(Stroke & stroke, const Quad<StepCoord> *waypoints, 
+	int16_t count, PH5TYPE blend) 
+{
+	if (POLYLINE_LEGS < count) {
+		return STATUS_STROKE_MAXLEN;
+	}
+	blend = max((PH5TYPE) 0, min((PH5TYPE) 1, blend));
+	PolylinePath path;
+	Quad<StepCoord> pos;
+	StepCoord pulses = 0;			// maximum axis travel
+	Quad<StepCoord> travel;
+	for (int16_t i = 0; i < count; i++) {
+		Quad<StepCoord> d(waypoints[i]);
+		d -= pos;
+		pos = waypoints[i];
+		if (d.isZero()) {
+			continue;
+		}
+		StepCoord dMax = dominantPulses(d);
+		for (QuadIndex j = 0; j < QUAD_ELEMENTS; j++) {
+			travel.value[j] += abs(d.value[j]);
+			pulses = max(travel.value[j], pulses);
+		}
+		// quintic peak velocity is 1.875*d/T and peak acceleration is 5.77*d/T^2
+		PH5TYPE vLeg = lineVMax(d);
+		PH5TYPE dt = max(1.875 * dMax / vLeg, sqrt(5.7735 * dMax * vMaxSeconds / vLeg));
+		PH5TYPE t = 0;
+		int16_t n = path.nLegs;
+		if (n) {
+			t = path.tLeg[n-1] + path.dtLeg[n-1] - blend * min(path.dtLeg[n-1], dt);
+		}
+		path.dLeg[n] = d;
+		path.tLeg[n] = t;
+		path.dtLeg[n] = dt;
+		path.nLegs++;
+		path.tS = max(path.tS, t + dt);
+	}
+	path.dEndPos = pos;
+	stroke.clear();
+	if (path.nLegs == 0) {
+		return STATUS_STROKE_NULL_ERROR;
+	}
+
+	PH5TYPE tS = path.tS;
+	int16_t N = segmentCount(tS, pulses, SEGMENT_COUNT-1);
+	Status status = pathSegments(stroke, path, N, (StepCoord *) NULL);
+	if (status != STATUS_OK) {
+		TESTCOUT1(" buildPolyline status:", status);
+		return status;
+	}
+	// stretch planned time if segment rounding exceeds any motor velocity limit
+	Quad<StepCoord> v;
+	Quad<StepCoord> vMotor;			// peak segment velocity of each motor
+	for (SegIndex s = 0; s < stroke.length; s++) {
+		for (QuadIndex j = 0; j < QUAD_ELEMENTS; j++) {
+			v.value[j] += stroke.scale * (StepCoord) stroke.seg[s].value[j];
+			vMotor.value[j] = max(vMotor.value[j], (StepCoord) abs(v.value[j]));
+		}
+	}
+	for (QuadIndex j = 0; j < QUAD_ELEMENTS; j++) {
+		int32_t vLimit = (motorVMax[j] > 0 && motorVMax[j] < vMax) ? motorVMax[j] : vMax;
+		tS = max(tS, (PH5TYPE) vMotor.value[j] * N / vLimit);
+	}
+	TESTCOUT4("buildPolyline legs:", path.nLegs, " N:", N, " tS:", tS, " scale:", stroke.scale);
+	stroke.setTimePlanned(tS);
+
+	return STATUS_OK;
+}
+
+/**
+ * Return the number of segments for a stroke of the given duration
+ * whose dominant axis travels the given number of pulses
+ */
+int16_t StrokeBuilder::segmentCount(PH5TYPE tS, StepCoord pulses, int16_t maxCount) {
     int16_t N = 1000 * tS / 40; // 40ms/segment
 	int16_t minSegs = minSegments;
 	if (minSegs == 0) {
@@ -314,46 +1183,304 @@ Status StrokeBuilder::buildLine(Stroke & stroke, Quad<StepCoord> relPos) {
 			TESTCOUT1("minSegsK:", minSegsK);
 			minSegs = minSegsK;
 		}
-		minSegs = max((int16_t)16, min((int16_t)(SEGMENT_COUNT-1), minSegs));
-	}
-
-    N = max(minSegs, min(maxSegments, (int16_t)N)); 
-    Quad<StepCoord> s;
-    Quad<StepCoord> v;
-    Quad<StepCoord> sNew;
-    Quad<StepCoord> vNew;
-    Quad<StepCoord> dv;
-    Quad<StepDV> segment;
-	E = phf[iMax].Ekt(E, 0);
-    for (int16_t iSeg = 1; iSeg <= N; iSeg++) {
-        PH5TYPE fSeg = iSeg / (PH5TYPE)N;
-        E = phf[iMax].Ekt(E, fSeg);
-        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-			PH5TYPE pos = ph[i].r(E).Re();
-            sNew.value[i] = pos < 0 ? pos-0.5 : pos+0.5;
-			vNew.value[i] = sNew.value[i] - s.value[i];
-			stroke.vPeak = max(stroke.vPeak, (int32_t)abs(vNew.value[i]));
-			dv.value[i] = vNew.value[i] - v.value[i];
-        }
-        TESTCOUT4("fSeg:", fSeg, " sNew:", sNew.toString(), 
-			" vNew:", vNew.toString(), " dv:", dv.toString());
-        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
-            if (dv.value[i] < (StepCoord) - 127 || (StepCoord) 127 < dv.value[i]) {
-				TESTCOUT1(" STATUS_STROKE_SEGPULSES pulses", dv.value[i]);
-                return STATUS_STROKE_SEGPULSES;
-            }
-            segment.value[i] = dv.value[i];
-        }
-		int16_t rc = stroke.append(segment);
-		if (rc < 0) {
-			return (Status) rc;
+		minSegs = max((int16_t)16, min(maxCount, minSegs));
+	}
+
+    return max(minSegs, min(maxSegments, (int16_t)N)); 
+}
+
+/////////////////// StrokeGenerator ////////////////
+
+/**
+ * Placement new that rebuilds the feed of a planned line in place.
+ * PHFeed refers to its curve, so it cannot be assigned.
+ */
+struct FeedSlot {};
+inline void *operator new(size_t, void *p, FeedSlot) {
+	return p;
+}
+
+StrokeGenerator::StrokeGenerator()
+	: phf(line.ph, 1, 1), vMax(0), vMaxSeconds(0), E(0), nGen(0), 
+	  tStart(0), dtTotal(0), dtPlanned(0), vPeak(0), curSeg(0), length(0) {
+}
+
+StrokeGenerator::StrokeGenerator(const StrokeGenerator &that)
+	: line(that.line), phf(line.ph, 1, 1), vMax(that.vMax), vMaxSeconds(that.vMaxSeconds), 
+	  E(that.E), nGen(that.nGen), dPos(that.dPos), tStart(that.tStart), dtTotal(that.dtTotal), 
+	  dtPlanned(that.dtPlanned), vPeak(that.vPeak), curSeg(that.curSeg), length(that.length), dEndPos(that.dEndPos) {
+	for (int16_t i = 0; i < GENERATOR_WINDOW; i++) {
+		segPos[i] = that.segPos[i];
+	}
+	planFeed();
+}
+
+StrokeGenerator::StrokeGenerator(StrokeBuilder &sb, Quad<StepCoord> relPos)
+	: phf(line.ph, 1, 1), vMax(0), vMaxSeconds(0), E(0), nGen(0), 
+	  tStart(0), dtTotal(0), dtPlanned(0), vPeak(0), curSeg(0), length(0) {
+	plan(sb, relPos);
+}
+
+/**
+ * Rebuild the feed for the current line, vMax and vMaxSeconds
+ */
+void StrokeGenerator::planFeed() {
+	if (line.pulses) {
+		phf.~PHFeed<PH5TYPE>();
+		new (&phf, FeedSlot()) PHFeed<PH5TYPE>(line.ph, vMax, vMaxSeconds);
+	}
+}
+
+/**
+ * Plan the same rest-to-rest line as StrokeBuilder::buildLine() without
+ * evaluating any segments. Segments are evaluated on demand by generate().
+ */
+void StrokeGenerator::plan(StrokeBuilder &sb, Quad<StepCoord> relPos) {
+	line = PH5Line(relPos);
+	vMax = sb.lineVMax(relPos);
+	vMaxSeconds = sb.vMaxSeconds;
+	dEndPos = relPos;
+	tStart = 0;
+	dtPlanned = dtTotal = 0;
+	length = 0;
+	planFeed();
+	if (line.pulses) {
+		PH5TYPE tS = phf.get_tS();
+		dtPlanned = dtTotal = MS_TICKS_REAL(tS * 1000);
+		StrokeBuilder sbLine(sb); // not limited by SEGMENT_COUNT or maxSegments
+		sbLine.maxSegments = 0x7fff;
+		length = sbLine.segmentCount(tS, line.pulses, 0x7fff);
+	}
+}
+
+float StrokeGenerator::getTimePlanned() {
+	return dtTotal / (float) TICKS_PER_SECOND;
+}
+
+/**
+ * Start traversal at the given tick. Only the first segment is evaluated.
+ */
+Status StrokeGenerator::start(Ticks tStart) {
+	this->tStart = tStart;
+	if (dtTotal <= 0 || length <= 0) {
+		return STATUS_STROKE_TIME;
+	}
+	dPos = Quad<StepCoord>();
+	curSeg = 0;
+	nGen = 0;
+	vPeak = 0;
+	E = 0;
+	generate();
+	return STATUS_OK;
+}
+
+/**
+ * Scale traversal time to the given feed rate percentage of the planned
+ * time. A started line continues from its current position.
+ */
+void StrokeGenerator::setFeedRate(Ticks tNow, int16_t percent) {
+	if (percent <= 0 || dtPlanned <= 0) {
+		return;
+	}
+	Ticks dtNew = (dtPlanned / percent) * 100 + ((dtPlanned % percent) * 100) / percent;
+	if (dtNew <= 0 || dtNew == dtTotal) {
+		return;
+	}
+	Ticks dt = tNow - tStart;
+	if (tStart && 0 < dt && dt < dtTotal) {
+		tStart = tNow - (Ticks)((float) dt * dtNew / dtTotal);
+		if (tStart == 0) {
+			tStart = -1; // zero means not started
 		}
-        v = vNew;
-        s = sNew;
+	}
+	dtTotal = dtNew;
+}
+
+/**
+ * Evaluate the end position of the next segment if the look-ahead window
+ * has room for it. Return true if a segment was generated.
+ */
+bool StrokeGenerator::generate() {
+	if (nGen >= length || nGen >= curSeg + GENERATOR_WINDOW - 1) {
+		return false;
+	}
+	Quad<StepCoord> pos;
+	if (nGen + 1 >= length) {
+		pos = dEndPos;
+	} else {
+		E = phf.Ekt(E, (nGen + 1) / (PH5TYPE) length);
+		line.position(pos, E);
+	}
+	Quad<StepCoord> posPrev;
+	if (nGen) {
+		posPrev = segPos[(nGen - 1) % GENERATOR_WINDOW];
+	}
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+		vPeak = max(vPeak, (int32_t) abs(pos.value[i] - posPrev.value[i]));
+	}
+	segPos[nGen % GENERATOR_WINDOW] = pos;
+	nGen++;
+	return true;
+}
+
+/**
+ * Return ticks from start to the start of the given segment. Long lines
+ * overflow iSeg * dtTotal, so the remainder is scaled separately.
+ */
+Ticks StrokeGenerator::segTicks(int16_t iSeg) {
+	Ticks q = dtTotal / length;
+	Ticks r = dtTotal - q * length;
+	return iSeg * q + ((int32_t) iSeg * r) / length;
+}
+
+/**
+ * Return goal position at the given tick, which must not decrease.
+ * Segments not yet generated are generated on demand.
+ */
+Quad<StepCoord> StrokeGenerator::goalPos(Ticks t) {
+	Ticks dt = t - tStart;
+	if (dt <= 0 || dtTotal <= 0 || length <= 0) {
+		return Quad<StepCoord>();
+	}
+	if (dt >= dtTotal) {
+		return dEndPos;
+	}
+	Ticks dtSegEnd = segTicks(curSeg + 1);
+	while (dtSegEnd <= dt && curSeg + 1 < length) {
+		curSeg++;
+		dtSegEnd = segTicks(curSeg + 1);
+	}
+	while (nGen <= curSeg && generate()) {
+		// catch up
+	}
+	Ticks dtSegStart = segTicks(curSeg);
+	Ticks tNum = min(dt, dtSegEnd) - dtSegStart;
+	Quad<StepCoord> pos0;
+	if (curSeg) {
+		pos0 = segPos[(curSeg - 1) % GENERATOR_WINDOW];
+	}
+	Quad<StepCoord> &pos1 = segPos[curSeg % GENERATOR_WINDOW];
+	Quad<StepCoord> dGoal;
+	for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+		int32_t v = pos1.value[i] - pos0.value[i];
+		dGoal.value[i] = pos0.value[i] + (tNum * v) / (dtSegEnd - dtSegStart);
+	}
+	return dGoal;
+}
+
+/**
+ * Step to the goal position of the current tick, then evaluate the next
+ * segment while the current segment is being traversed
+ */
+Status StrokeGenerator::traverse(Ticks tCurrent, QuadStepper &stepper) {
+    if (tStart == 0) {
+        return STATUS_STROKE_START;
     }
-    TESTCOUT3(" N:", N, " tS:", tS, " dEndPos:", stroke.dEndPos.toString());
-    stroke.setTimePlanned(tS);
+    Quad<StepCoord> dGoal = goalPos(tCurrent);
+	Status status = stepBlocks(stepper, dPos, dGoal - dPos);
+	if (status < 0) {
+		return status;
+	}
+	generate();
+	return (tCurrent >= tStart + dtTotal) ? STATUS_OK : STATUS_BUSY_MOVING;
+}
 
-    return STATUS_OK;
+/////////////////// StrokeCache ////////////////
+
+#ifdef STROKE_CACHE_SIZE
+StrokeCache::StrokeCache() {
+	clear();
+}
+
+void StrokeCache::clear() {
+	for (uint8_t i = 0; i < STROKE_CACHE_SIZE; i++) {
+		entry[i].length = 0;
+	}
+	iNext = 0;
+	hits = 0;
+	misses = 0;
+}
+
+/**
+ * Return id of cached line built by the given builder, or -1 if not cached
+ */
+int8_t StrokeCache::find(StrokeBuilder &sb, Quad<StepCoord> relPos) {
+	for (uint8_t i = 0; i < STROKE_CACHE_SIZE; i++) {
+		StrokeCacheEntry &e = entry[i];
+		if (e.length && e.relPos == relPos && e.vMax == sb.vMax &&
+				e.vMaxSeconds == sb.vMaxSeconds &&
+				e.minSegments == sb.minSegments && e.maxSegments == sb.maxSegments &&
+				e.maxDeviation == sb.maxDeviation) {
+			QuadIndex iMotor = 0;
+			while (iMotor < QUAD_ELEMENTS && e.motorVMax[iMotor] == sb.motorVMax[iMotor]) {
+				iMotor++;
+			}
+			if (iMotor == QUAD_ELEMENTS) {
+				return i;
+			}
+		}
+	}
+	return -1;
 }
 
+/**
+ * Same as StrokeBuilder::buildLine(), but a line that was built before with
+ * the same builder settings is copied from the cache instead of being planned.
+ * Built lines replace the least recently built cache entry.
+ * Returns the cache id of the line.
+ */
+Status StrokeCache::buildLine(StrokeBuilder &sb, Stroke &stroke, Quad<StepCoord> relPos, int8_t &id) {
+	id = find(sb, relPos);
+	if (id >= 0) {
+		return load(id, stroke);
+	}
+	misses++;
+	Status status = sb.buildLine(stroke, relPos);
+	if (status != STATUS_OK) {
+		return status;
+	}
+	id = iNext;
+	iNext = (iNext + 1) % STROKE_CACHE_SIZE;
+	StrokeCacheEntry &e = entry[id];
+	e.relPos = relPos;
+	e.vMax = sb.vMax;
+	e.vMaxSeconds = sb.vMaxSeconds;
+	e.minSegments = sb.minSegments;
+	e.maxSegments = sb.maxSegments;
+	e.maxDeviation = sb.maxDeviation;
+	for (QuadIndex iMotor = 0; iMotor < QUAD_ELEMENTS; iMotor++) {
+		e.motorVMax[iMotor] = sb.motorVMax[iMotor];
+	}
+	e.scale = stroke.scale;
+	e.dtTotal = stroke.getTotalTicks();
+	e.vPeak = stroke.vPeak;
+	e.length = stroke.length;
+	for (SegIndex s = 0; s < stroke.length; s++) {
+		e.seg[s] = stroke.seg[s];
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Replace stroke with the cached line of the given id
+ */
+Status StrokeCache::load(int8_t id, Stroke &stroke) {
+	if (id < 0 || STROKE_CACHE_SIZE <= id || entry[id].length == 0) {
+		return STATUS_STROKE_CACHE_ID;
+	}
+	hits++;
+	StrokeCacheEntry &e = entry[id];
+	stroke.clear();
+	for (SegIndex s = 0; s < e.length; s++) {
+		stroke.seg[s] = e.seg[s];
+	}
+	stroke.length = e.length;
+	stroke.vPeak = e.vPeak;
+	if (e.scale != 1) {
+		stroke.scale = e.scale;
+		stroke.dEndPos = e.relPos;
+	}
+	stroke.setTotalTicks(e.dtTotal);
+	return STATUS_OK;
+}
+#endif
@@ -13,6 +13,8 @@
 namespace firestep {
 
 #define SEGMENT_COUNT 150
+// #define STROKE_POSITION_TABLE /* O(1) goalPos() using 4*sizeof(StepCoord)*SEGMENT_COUNT bytes */
+// #define PH5_FIXED /* StrokeBuilder evaluates PH5 line positions in fixed point instead of float */
 
 typedef int8_t  StepDV;			// change in StepCoord velocity
 typedef int16_t StepCoord;		// stepper coordinate (i.e., pulses)
@@ -26,32 +28,53 @@ typedef class QuadStepper {
 		// ProtocolB: stepDirection(); stepFast();
         virtual Status stepDirection(const Quad<StepDV> &pulse) = 0;
         virtual Status stepFast(Quad<StepDV> &pulse) = 0;
+
+		// ProtocolC: stepSegment();
+        virtual Status stepSegment(const Quad<StepCoord> &dPos, Ticks dt);
 } QuadStepper;
 
 typedef class Stroke {
     private:
         Quad<StepCoord> dPos;				// current offset from start position
         Ticks			dtTotal;			// ticks for planned traversal
+        Ticks			dtPlanned;			// ticks for planned traversal at 100% feed rate
+        Quad<StepCoord> vSeg;				// velocity accumulated through seg[curSeg-1]
+        Quad<StepCoord> aSeg;				// acceleration accumulated through seg[curSeg-1]
+        Quad<StepCoord> posSeg;				// position accumulated through seg[curSeg-1]
+        SegIndex		ddaSeg;				// next segment for traverseDDA()
+        uint16_t		ddaSlice;			// next slice of ddaSeg for traverseDDA()
+        uint16_t		ddaSlices;			// slices of ddaSeg
+#ifdef STROKE_POSITION_TABLE
+        Quad<StepCoord> segPos[SEGMENT_COUNT];	// position at end of each segment
+#endif
     public:
         Ticks			tStart;				// ticks at start of traversal
         int32_t			vPeak;				// peak velocity on any axis
         StepCoord		maxEndPulses;		// max pulse offset for end position (default 16)
         StepCoord		scale;				// segment velocity unit
+        uint8_t			order;				// 1:seg is velocity delta; 2:seg is acceleration delta
         SegIndex		curSeg;				// current segment index
         SegIndex	 	length;				// number of segments
-        Quad<StepDV> 	seg[SEGMENT_COUNT];	// delta velocity
+        Quad<StepDV> 	seg[SEGMENT_COUNT];	// delta velocity (or acceleration if order is 2)
         Quad<StepCoord>	dEndPos;			// ending offset
+        bool			dda;				// traverse() emits segment slices with ProtocolC (see StepEngine)
+        Quad<StepCoord>	dPosMin;			// minimum offset reached by traversal (set by start())
+        Quad<StepCoord>	dPosMax;			// maximum offset reached by traversal (set by start())
+        bool			travelChecked;		// dPosMin/dPosMax are within travel limits (see Machine)
     public:
         Stroke();
         void clear();
         Status start(Ticks tStart);
         Status traverse(Ticks tCurrent, QuadStepper &quadStep);
+        Status traverseDDA(Ticks tCurrent, QuadStepper &quadStep);
         bool isDone();
         Quad<StepCoord> goalPos(Ticks t);
+        Quad<StepCoord> goalPosIncremental(Ticks t);
         Ticks goalStartTicks(Ticks t);
         Ticks goalEndTicks(Ticks t);
         SegIndex goalSegment(Ticks t);
         int16_t append(Quad<StepDV> dv);
+        Status setOrder(uint8_t order);
         inline Quad<StepCoord>& position() {
             return dPos;
         }
@@ -61,21 +84,145 @@ typedef class Stroke {
         float getTimePlanned();
         Ticks getTotalTicks();
         void setTimePlanned(float seconds);
+        void setTotalTicks(Ticks dt);
+        void setFeedRate(Ticks tNow, int16_t percent);
 } Stroke;
 
+typedef int32_t PH5Fixed;		// fixed point number with PH5FIXED_BITS fraction bits
+#define PH5FIXED_BITS 24 /* Q7.24 keeps line positions within 1 pulse of float over 32767 pulses */
+#define PH5FIXED_ONE ((PH5Fixed) 1 << PH5FIXED_BITS)
+#define PH5FIXED_EBITS 16 /* curve parameter E is Q0.16 so that products fit 32 bits */
+
+typedef class PH5FixedLine {
+    private:
+        PH5Fixed	c[6];	// coefficients of travel fraction polynomial in E
+    public:
+        PH5FixedLine(ph5::PH5Curve<PH5TYPE> &ph, StepCoord pulses);
+        PH5Fixed fraction(PH5TYPE E);
+        static StepCoord travel(PH5Fixed f, StepCoord pulses);
+} PH5FixedLine;
+
+/**
+ * Dominant axis PH5 curve of a rest-to-rest line to a motor offset.
+ * Every motor travels the same fraction of its offset at curve parameter E.
+ */
+typedef class PH5Line {
+    public:
+        StepCoord		pulses;				// travel of dominant axis
+        ph5::PH5Curve<PH5TYPE> ph;		// PH5 curve of dominant axis
+#ifdef PH5_FIXED
+        PH5FixedLine	fixedLine;			// fixed point evaluation of ph
+#endif
+        Quad<StepCoord>	dEndPos;			// ending offset
+    public:
+        PH5Line(const Quad<StepCoord> &relPos = Quad<StepCoord>());
+        PH5TYPE fraction(PH5TYPE E);
+        void position(Quad<StepCoord> &pos, PH5TYPE E);
+} PH5Line;
+
+class DeltaCalculator;
+class XYZ;
+
 typedef class StrokeBuilder {
     public:
         int32_t		vMax; // max pulses per second
         float 		vMaxSeconds; // seconds to achieve vMax
         int16_t		minSegments; // minimum number of stroke segments (default 20)
         int16_t		maxSegments; // maximum number of stroke segments (defuault 50);
+        StepCoord	maxDeviation; // max pulses from PH5 line for adaptive segment count (0: fixed count)
+        int32_t		motorVMax[QUAD_ELEMENTS]; // max pulses per second of each motor (0: vMax)
 
     public:
         StrokeBuilder(int32_t vMax = 12800, float vMaxSeconds = 0.5,
-                      int16_t minSegments = 20, int16_t maxSegments = 50);
+                      int16_t minSegments = 20, int16_t maxSegments = 50, StepCoord maxDeviation = 0);
         Status buildLine(Stroke & stroke, Quad<StepCoord> dPos);
+        Status buildPolyline(Stroke & stroke, const Quad<StepCoord> *waypoints, int16_t count,
+                             PH5TYPE blend = 0.5);
+        int16_t segmentCount(PH5TYPE tS, StepCoord pulses, int16_t maxCount);
+        int32_t lineVMax(const Quad<StepCoord> &relPos);
+        Status buildDeltaLine(Stroke & stroke, DeltaCalculator &delta, const XYZ &xyz1, const XYZ &xyz2);
+        Status buildArc(Stroke & stroke, Quad<StepCoord> center, PH5TYPE sweep,
+                        Quad<StepCoord> helix = Quad<StepCoord>());
 } StrokeBuilder;
 
+// #define STROKE_CACHE_SIZE 2 /* built lines kept for lin replay (RAM: STROKE_CACHE_SIZE*(4*SEGMENT_COUNT+52) bytes) */
+
+#ifdef STROKE_CACHE_SIZE
+typedef struct StrokeCacheEntry {
+    Quad<StepCoord>	relPos;				// key: line end offset
+    int32_t			vMax;				// key: StrokeBuilder::vMax
+    float			vMaxSeconds;		// key: StrokeBuilder::vMaxSeconds
+    int16_t			minSegments;		// key: StrokeBuilder::minSegments
+    int16_t			maxSegments;		// key: StrokeBuilder::maxSegments
+    StepCoord		maxDeviation;		// key: StrokeBuilder::maxDeviation
+    int32_t			motorVMax[QUAD_ELEMENTS];	// key: StrokeBuilder::motorVMax
+    StepCoord		scale;				// segment velocity unit
+    Ticks			dtTotal;			// ticks for planned traversal
+    int32_t			vPeak;				// peak velocity on any axis
+    SegIndex		length;				// number of segments (0 if unused)
+    Quad<StepDV>	seg[SEGMENT_COUNT];	// delta velocity
+} StrokeCacheEntry;
+
+typedef class StrokeCache {
+    private:
+        StrokeCacheEntry entry[STROKE_CACHE_SIZE];
+        uint8_t			iNext;				// next entry to replace
+    public:
+        int32_t			hits;				// buildLine() requests served from cache
+        int32_t			misses;				// buildLine() requests that were built
+    public:
+        StrokeCache();
+        void clear();
+        int8_t find(StrokeBuilder &sb, Quad<StepCoord> relPos);
+        Status buildLine(StrokeBuilder &sb, Stroke &stroke, Quad<StepCoord> relPos, int8_t &id);
+        Status load(int8_t id, Stroke &stroke);
+} StrokeCache;
+#endif
+
+#define GENERATOR_WINDOW 4 /* segment end positions kept by StrokeGenerator (>= 2) */
+// #define STROKE_GENERATOR /* lin "od":true lines of any length (RAM: sizeof(StrokeGenerator)) */
+
+typedef class StrokeGenerator {
+    private:
+        PH5Line			line;				// line curve
+        ph5::PHFeed<PH5TYPE> phf;			// feed of line curve (refers to line.ph)
+        int32_t			vMax;				// max pulses per second of dominant axis
+        float			vMaxSeconds;		// seconds to achieve vMax
+        PH5TYPE			E;					// curve parameter at end of last generated segment
+        int16_t			nGen;				// number of generated segments
+        Quad<StepCoord>	segPos[GENERATOR_WINDOW];	// ring of generated segment end positions
+        Quad<StepCoord>	dPos;				// current offset from start position
+    private:
+        StrokeGenerator& operator=(const StrokeGenerator &that); // not assignable
+        void planFeed();
+        Ticks segTicks(int16_t iSeg);
+    public:
+        Ticks			tStart;				// ticks at start of traversal
+        Ticks			dtTotal;			// ticks for planned traversal
+        Ticks			dtPlanned;			// ticks for planned traversal at 100% feed rate
+        int32_t			vPeak;				// peak segment velocity on any axis
+        int16_t			curSeg;				// current segment index
+        int16_t			length;				// number of segments (not limited by SEGMENT_COUNT)
+        Quad<StepCoord>	dEndPos;			// ending offset
+    public:
+        StrokeGenerator();
+        StrokeGenerator(const StrokeGenerator &that);
+        StrokeGenerator(StrokeBuilder &sb, Quad<StepCoord> relPos);
+        void plan(StrokeBuilder &sb, Quad<StepCoord> relPos);
+        Status start(Ticks tStart);
+        void setFeedRate(Ticks tNow, int16_t percent);
+        bool generate();
+        Quad<StepCoord> goalPos(Ticks t);
+        Status traverse(Ticks tCurrent, QuadStepper &quadStep);
+        inline Quad<StepCoord>& position() {
+            return dPos;
+        }
+        inline int16_t getGenerated() {
+            return nGen;
+        }
+        float getTimePlanned();
+} StrokeGenerator;
+
 } // namespace firestep
 
 #endif
@@ -43,6 +43,7 @@ typedef uint8_t boolean;
 #define MUX0 0
 #define PRADC 0
 #define TOIE1 0
+#define OCIE1A 1
 #define CS10 0
 #define CS11 1
 #define CS12 2
@@ -59,6 +60,7 @@ typedef uint8_t boolean;
 #define TCCR1B arduino.MEM(9)
 #define TCNT1 arduino.MEM(10)
 #define TIMSK1 arduino.MEM(11)
+#define OCR1A arduino.MEM(12)
 
 #define cli() (SREGI=0)
 #define sei() (SREGI=1)
@@ -100,22 +102,34 @@ int16_t digitalRead(int16_t dirPin);
 void pinMode(int16_t pin, int16_t inout);
 void delay(int ms);
 
+// Simulated Arduino port registers (port = pin/8 + 1, bit = pin%8)
+#define NOT_A_PIN 0
+uint8_t digitalPinToPort(int16_t pin);
+uint8_t digitalPinToBitMask(int16_t pin);
+volatile uint8_t *portOutputRegister(uint8_t port);
+int16_t portBitPin(volatile uint8_t *out, uint8_t bit);
+
 extern SerialType Serial;
 
 #define ARDUINO_PINS 127
+#define ARDUINO_PORTS ((ARDUINO_PINS+7)/8+1)
 #define ARDUINO_MEM 1024
 typedef class MockDuino {
 	friend void delayMicroseconds(uint16_t us);
 	friend void digitalWrite(int16_t pin, int16_t value);
 	friend int16_t digitalRead(int16_t pin);
 	friend void pinMode(int16_t pin, int16_t inout);
+	friend volatile uint8_t *portOutputRegister(uint8_t port);
+	friend int16_t portBitPin(volatile uint8_t *out, uint8_t bit);
 	private: 
 		int16_t pin[ARDUINO_PINS];
         int16_t _pinMode[ARDUINO_PINS];
 		int32_t pinPulses[ARDUINO_PINS];
+		volatile uint8_t port[ARDUINO_PORTS];
         int16_t mem[ARDUINO_MEM];
 		int32_t usDelay;
     public:
+		void (*isrTimer1CompA)(); // simulated TIMER1_COMPA_vect interrupt handler
 
     public:
         MockDuino();
@@ -149,7 +149,9 @@ void MockDuino::clear() {
         mem[i] = NOVALUE;
     }
     memset(pinPulses, 0, sizeof(pinPulses));
+    memset((void *) port, 0, sizeof(port));
     usDelay = 0;
+    isrTimer1CompA = NULL;
     ADCSRA = 0;	// ADC control and status register A (disabled)
     TCNT1 = 0; 	// Timer/Counter1
     CLKPR = 0;	// Clock prescale register
@@ -183,9 +185,22 @@ void MockDuino::dump() {
     }
 }
 
+/**
+ * Advance Timer1, raising the simulated compare match interrupt
+ * for each tick at which TCNT1 reaches OCR1A
+ */
 void MockDuino::timer1(int increment) {
     if (TIMER_ENABLED) {
-        TCNT1 += increment;
+		if (isrTimer1CompA == NULL) {
+			TCNT1 += increment;
+		} else {
+			for (int i = 0; i < increment; i++) {
+				TCNT1++;
+				if ((TIMSK1 & (1 << OCIE1A)) && TCNT1 == OCR1A) {
+					isrTimer1CompA();
+				}
+			}
+		}
     }
 }
 
@@ -240,6 +255,28 @@ void MockDuino::setPinMode(int16_t pin, int16_t value) {
     }
 }
 
+uint8_t digitalPinToPort(int16_t pin) {
+    if (pin < 0 || ARDUINO_PINS <= pin) {
+        return NOT_A_PIN;
+    }
+    return pin / 8 + 1;
+}
+
+uint8_t digitalPinToBitMask(int16_t pin) {
+    return 1 << (pin % 8);
+}
+
+volatile uint8_t *portOutputRegister(uint8_t port) {
+    ASSERT(NOT_A_PIN < port && port < ARDUINO_PORTS);
+    return &arduino.port[port];
+}
+
+int16_t portBitPin(volatile uint8_t *out, uint8_t bit) {
+    int16_t port = out - arduino.port;
+    ASSERT(NOT_A_PIN < port && port < ARDUINO_PORTS);
+    return (port - 1) * 8 + bit;
+}
+
 void delay(int ms) {
     arduino.timer1(MS_TICKS(ms));
 }
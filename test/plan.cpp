@@ -0,0 +1,339 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+#include <unistd.h>
+#include "Stroke.h"
+#include "DeltaCalculator.h"
+
+using namespace std;
+using namespace firestep;
+
+/**
+ * Host stroke planner. Reads absolute waypoints (one per line, up to four
+ * motor positions in pulses) and writes one dvs command per move, built
+ * with the same StrokeBuilder code as the firmware. Moves are planned in
+ * parallel on all cores and written in input order.
+ *
+ * With -k, waypoints are delta robot Cartesian positions (x,y,z in mm)
+ * planned with buildDeltaLine(). The first waypoint is the start position,
+ * since the firmware has no forward kinematics to supply it.
+ *
+ * With -p, up to legs consecutive moves are planned as one stroke with
+ * buildPolyline(), which blends the corners between them.
+ *
+ * With -o 2, strokes are written with second order segments ("so":2),
+ * which are shorter for smooth profiles. Strokes whose second order
+ * segments do not fit StepDV are written with first order segments.
+ *
+ * Usage: plan [-v vMax] [-s vMaxSeconds] [-n minSegments] [-m maxSegments] [-d maxDeviation]
+ *             [-l motorVMax1,motorVMax2,motorVMax3,motorVMax4] [-j threads] [-k] [-p legs]
+ *             [-o order] [file]
+ */
+
+typedef struct PlanMove {
+    Quad<StepCoord>	relPos;		// motor offset from previous waypoint
+    XYZ				xyz1;		// delta start position (-k)
+    XYZ				xyz2;		// delta end position (-k)
+    vector<Quad<StepCoord> > waypoints;	// polyline waypoints relative to move start (-p)
+    Status			status;		// StrokeBuilder result
+    string			json;		// dvs command
+} PlanMove;
+
+typedef struct PlanBatch {
+    StrokeBuilder		sb;
+    vector<PlanMove>	moves;
+    int					nThreads;
+    bool				delta;
+    int					legs;		// waypoints per polyline stroke (-p)
+    int					order;		// stroke segment order (-o)
+} PlanBatch;
+
+typedef struct PlanWorker {
+    PlanBatch	*pBatch;
+    int			iThread;
+} PlanWorker;
+
+static string dvsJson(Stroke &stroke, Quad<StepCoord> relPos) {
+    ostringstream os;
+    // TICK_MICROSECONDS is exact, so pad half a tick to survive float truncation in setTimePlanned()
+    int32_t planMicros = stroke.getTotalTicks() * TICK_MICROSECONDS + TICK_MICROSECONDS / 2;
+    os << "{\"dvs\":{\"us\":" << planMicros;
+    if (stroke.scale != 1) {
+        os << ",\"sc\":" << stroke.scale;
+    }
+    if (stroke.order != 1) {
+        os << ",\"so\":" << (int) stroke.order;
+    }
+    os << ",\"dp\":[" << relPos.value[0] << "," << relPos.value[1] <<
+       "," << relPos.value[2] << "," << relPos.value[3] << "]";
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        bool idle = true;
+        for (SegIndex iSeg = 0; idle && iSeg < stroke.length; iSeg++) {
+            idle = stroke.seg[iSeg].value[i] == 0;
+        }
+        if (idle) {
+            continue; // motor is idle (polyline motors may move and return)
+        }
+        os << ",\"" << (i + 1) << "\":[";
+        for (SegIndex iSeg = 0; iSeg < stroke.length; iSeg++) {
+            os << (iSeg ? "," : "") << (int) stroke.seg[iSeg].value[i];
+        }
+        os << "]";
+    }
+    os << "}}";
+    return os.str();
+}
+
+static void *planThread(void *arg) {
+    PlanWorker &worker = *(PlanWorker *) arg;
+    PlanBatch &batch = *worker.pBatch;
+    StrokeBuilder sb(batch.sb);
+    Stroke stroke;
+    DeltaCalculator delta;
+    for (size_t i = worker.iThread; i < batch.moves.size(); i += batch.nThreads) {
+        PlanMove &move = batch.moves[i];
+        if (batch.delta) {
+            Quad<StepCoord> pulses1;
+            move.status = delta.calcPulses(move.xyz1, pulses1);
+            if (move.status == STATUS_OK) {
+                move.status = delta.calcPulses(move.xyz2, move.relPos);
+                move.relPos -= pulses1;
+            }
+            if (move.status == STATUS_OK) {
+                move.status = sb.buildDeltaLine(stroke, delta, move.xyz1, move.xyz2);
+            }
+        } else if (move.waypoints.size()) {
+            move.status = sb.buildPolyline(stroke, &move.waypoints[0], move.waypoints.size());
+        } else {
+            move.status = sb.buildLine(stroke, move.relPos);
+        }
+        if (move.status == STATUS_OK) {
+            stroke.setOrder(batch.order); // first order if segments do not fit
+            move.json = dvsJson(stroke, move.relPos);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Parse up to QUAD_ELEMENTS positions separated by anything but digits.
+ * Returns the number of positions parsed or -1 if there are too many.
+ */
+static int parseWaypoint(const string &line, Quad<StepCoord> &pos) {
+    const char *s = line.c_str();
+    QuadIndex n = 0;
+    while (*s) {
+        if (*s == '#') {
+            break;
+        }
+        if (*s == '-' || ('0' <= *s && *s <= '9')) {
+            char *end;
+            long value = strtol(s, &end, 10);
+            if (end == s) {
+                s++; // lone '-'
+                continue;
+            }
+            if (n >= QUAD_ELEMENTS) {
+                return -1;
+            }
+            pos.value[n++] = value;
+            s = end;
+        } else {
+            s++; // separator
+        }
+    }
+    return n;
+}
+
+/**
+ * Parse a Cartesian x,y,z position separated by anything but numbers.
+ * Returns the number of coordinates parsed or -1 if there are too many.
+ */
+static int parseXYZ(const string &line, XYZ &xyz) {
+    const char *s = line.c_str();
+    float *coord[] = { &xyz.x, &xyz.y, &xyz.z };
+    int n = 0;
+    while (*s) {
+        if (*s == '#') {
+            break;
+        }
+        if (*s == '-' || *s == '.' || ('0' <= *s && *s <= '9')) {
+            char *end;
+            double value = strtod(s, &end);
+            if (end == s) {
+                s++; // lone '-' or '.'
+                continue;
+            }
+            if (n >= 3) {
+                return -1;
+            }
+            *coord[n++] = value;
+            s = end;
+        } else {
+            s++; // separator
+        }
+    }
+    return n;
+}
+
+static int usage() {
+    cerr << "Usage: plan [-v vMax] [-s vMaxSeconds] [-n minSegments] "
+         "[-m maxSegments] [-d maxDeviation] [-l motorVMax1,...,motorVMax4] "
+         "[-j threads] [-k] [-p legs] [-o order] [file]" << endl;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    PlanBatch batch;
+    batch.nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    batch.delta = false;
+    batch.legs = 1;
+    batch.order = 1;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp("-v", argv[i]) == 0 && i + 1 < argc) {
+            batch.sb.vMax = atol(argv[++i]);
+        } else if (strcmp("-s", argv[i]) == 0 && i + 1 < argc) {
+            batch.sb.vMaxSeconds = atof(argv[++i]);
+        } else if (strcmp("-n", argv[i]) == 0 && i + 1 < argc) {
+            batch.sb.minSegments = atoi(argv[++i]);
+        } else if (strcmp("-m", argv[i]) == 0 && i + 1 < argc) {
+            batch.sb.maxSegments = atoi(argv[++i]);
+        } else if (strcmp("-d", argv[i]) == 0 && i + 1 < argc) {
+            batch.sb.maxDeviation = atoi(argv[++i]);
+        } else if (strcmp("-l", argv[i]) == 0 && i + 1 < argc) {
+            Quad<StepCoord> v;
+            if (parseWaypoint(argv[++i], v) <= 0) {
+                return usage();
+            }
+            for (QuadIndex j = 0; j < QUAD_ELEMENTS; j++) {
+                batch.sb.motorVMax[j] = v.value[j];
+            }
+        } else if (strcmp("-j", argv[i]) == 0 && i + 1 < argc) {
+            batch.nThreads = atoi(argv[++i]);
+        } else if (strcmp("-k", argv[i]) == 0) {
+            batch.delta = true;
+        } else if (strcmp("-p", argv[i]) == 0 && i + 1 < argc) {
+            batch.legs = atoi(argv[++i]);
+            if (batch.legs < 1) {
+                return usage();
+            }
+        } else if (strcmp("-o", argv[i]) == 0 && i + 1 < argc) {
+            batch.order = atoi(argv[++i]);
+            if (batch.order < 1 || 2 < batch.order) {
+                return usage();
+            }
+        } else if (argv[i][0] == '-' || path) {
+            return usage();
+        } else {
+            path = argv[i];
+        }
+    }
+    if (batch.nThreads < 1) {
+        batch.nThreads = 1;
+    }
+
+    ifstream file;
+    if (path) {
+        file.open(path);
+        if (!file) {
+            cerr << "plan: cannot open " << path << endl;
+            return 1;
+        }
+    }
+    istream &in = path ? file : cin;
+    Quad<StepCoord> pos;
+    XYZ xyz;
+    bool xyzStart = false;
+    string line;
+    for (int lineNum = 1; getline(in, line); lineNum++) {
+        if (batch.delta) {
+            XYZ xyzNext(xyz);
+            int n = parseXYZ(line, xyzNext);
+            if (n == 0) {
+                continue; // blank or comment
+            }
+            if (n < 0) {
+                cerr << "plan: line " << lineNum << ": expected at most 3 coordinates" << endl;
+                return 1;
+            }
+            bool moved = xyzNext.x != xyz.x || xyzNext.y != xyz.y || xyzNext.z != xyz.z;
+            if (xyzStart && moved) {
+                PlanMove move;
+                move.xyz1 = xyz;
+                move.xyz2 = xyzNext;
+                move.status = STATUS_OK;
+                batch.moves.push_back(move);
+            }
+            xyz = xyzNext;
+            xyzStart = true;
+            continue;
+        }
+        Quad<StepCoord> wp(pos);
+        int n = parseWaypoint(line, wp);
+        if (n == 0) {
+            continue; // blank or comment
+        }
+        if (n < 0) {
+            cerr << "plan: line " << lineNum << ": expected at most " <<
+                 QUAD_ELEMENTS << " positions" << endl;
+            return 1;
+        }
+        PlanMove move;
+        move.relPos = wp;
+        move.relPos -= pos;
+        move.status = STATUS_OK;
+        pos = wp;
+        if (move.relPos.isZero()) {
+            continue;
+        }
+        if (batch.legs > 1) {
+            if (batch.moves.empty() || (int) batch.moves.back().waypoints.size() >= batch.legs) {
+                PlanMove poly;
+                poly.status = STATUS_OK;
+                batch.moves.push_back(poly);
+            }
+            PlanMove &poly = batch.moves.back();
+            poly.relPos += move.relPos;
+            poly.waypoints.push_back(poly.relPos);
+        } else {
+            batch.moves.push_back(move);
+        }
+    }
+
+    // TESTCOUT diagnostics from the shared firmware code must not corrupt the dvs stream
+    streambuf *coutBuf = cout.rdbuf(cerr.rdbuf());
+    if (batch.nThreads > (int) batch.moves.size()) {
+        batch.nThreads = batch.moves.size() ? batch.moves.size() : 1;
+    }
+    vector<pthread_t> threads(batch.nThreads);
+    vector<PlanWorker> workers(batch.nThreads);
+    for (int i = 0; i < batch.nThreads; i++) {
+        workers[i].pBatch = &batch;
+        workers[i].iThread = i;
+        pthread_create(&threads[i], NULL, planThread, &workers[i]);
+    }
+    for (int i = 0; i < batch.nThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    cout.rdbuf(coutBuf);
+
+    // stop at the first failure, since later moves are relative to it
+    for (size_t i = 0; i < batch.moves.size(); i++) {
+        PlanMove &move = batch.moves[i];
+        if (move.status != STATUS_OK) {
+            cout.flush();
+            cerr << "plan: move " << (i + 1) << " " << move.relPos.toString() <<
+                 ": status " << move.status << endl;
+            return 2;
+        }
+        cout << move.json << endl;
+    }
+    return 0;
+}
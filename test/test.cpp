@@ -2,6 +2,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <sys/time.h>
 #include "FireLog.h"
 #include "FireUtils.hpp"
 #include "version.h"
@@ -9,6 +10,7 @@
 
 #include "MachineThread.h"
 #include "Display.h"
+#include "DeltaCalculator.h"
 
 byte lastByte;
 
@@ -29,10 +31,28 @@ class TestDisplay: public Display {
         }
 } testDisplay;
 
+/**
+ * With STEP_ENGINE, stroke pulses are emitted by the Timer1 compare ISR
+ * after they are queued, and a stroke ends only after they have been.
+ * Run the mock timer until the ISR has emitted them all, then restore
+ * TCNT1 so the planner sees the same ticks as with synchronous stepping.
+ */
+void test_drain() {
+#ifdef STEP_ENGINE
+    int16_t tcnt1 = TCNT1;
+    for (int32_t i = 0; arduino.isrTimer1CompA && (TIMSK1 & (1 << OCIE1A)); i++) {
+        ASSERT(i < 0x10000);
+        arduino.timer1(1);
+    }
+    TCNT1 = tcnt1;
+#endif
+}
+
 void test_ticks(int nTicks) {
     arduino.timer1(nTicks-1);
 	ticks();
     threadRunner.outerLoop();
+    test_drain();
 }
 
 void test_Serial() {
@@ -161,6 +181,55 @@ void test_Machine() {
     ASSERTEQUAL(3, arduino.pulses(PC2_Y_STEP_PIN));
     ASSERTEQUAL(3, arduino.pulses(PC2_Z_STEP_PIN));
 
+    // stepFast() pulses motors with step pins on the same port together
+    Quad<StepDV> fast(3, -2, 1, 0);
+    ASSERTEQUAL(STATUS_OK, machine.stepFast(fast));
+    ASSERTEQUAL(6, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(5, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(4, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERT(machine.axis[0].stepPort != machine.axis[1].stepPort);
+    PinType pinShared = 53; // MockDuino port of PC2_X_STEP_PIN
+    machine.setPin(machine.axis[1].pinStep, pinShared, OUTPUT);
+    ASSERT(machine.axis[0].stepPort == machine.axis[1].stepPort);
+    ASSERT(machine.axis[0].stepMask != machine.axis[1].stepMask);
+    ASSERTEQUAL(1, arduino.pulses(pinShared));
+    ASSERTEQUAL(STATUS_OK, machine.stepFast(fast));
+    ASSERTEQUAL(9, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(3, arduino.pulses(pinShared));
+    ASSERTEQUAL(5, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(5, arduino.pulses(PC2_Z_STEP_PIN));
+    machine.setPin(machine.axis[1].pinStep, PC2_Y_STEP_PIN, OUTPUT);
+    ASSERT(machine.axis[0].stepPort != machine.axis[1].stepPort);
+
+    // feed rate override rescales current and queued strokes
+    for (int i = 0; i < STROKE_BUFFERS; i++) {
+        Stroke &s = *machine.strokeBuffer();
+        s.clear();
+        s.append(Quad<StepDV>(1, 0, 0, 0));
+        s.append(Quad<StepDV>(-1, 0, 0, 0));
+        s.setTimePlanned(100 / (float) TICKS_PER_SECOND);
+        ASSERTEQUAL(STATUS_OK, s.start(machine.strokeStartTicks(1000)));
+        machine.queueStroke();
+    }
+    ASSERTEQUAL(100, machine.getFeedRate());
+    Ticks dt0 = machine.stroke().get_dtTotal();
+    ASSERTEQUAL(STATUS_FIELD_RANGE_ERROR, machine.setFeedRate(FEED_RATE_MIN - 1, 1050));
+    ASSERTEQUAL(STATUS_FIELD_RANGE_ERROR, machine.setFeedRate(FEED_RATE_MAX + 1, 1050));
+    ASSERTEQUAL(STATUS_OK, machine.setFeedRate(50, 1050));
+    ASSERTEQUAL(50, machine.getFeedRate());
+    ASSERTEQUAL(2 * dt0, machine.stroke().get_dtTotal());
+    ASSERTEQUAL(1050 - 100, machine.stroke().tStart);
+    Ticks tEnd = machine.stroke().tStart + 2 * dt0;
+#if STROKE_BUFFERS > 1
+    ASSERTEQUAL(tEnd + 2 * dt0, machine.strokeStartTicks(1050));
+    machine.dequeueStroke();
+    ASSERTEQUAL(tEnd, machine.stroke().tStart);
+    ASSERTEQUAL(2 * dt0, machine.stroke().get_dtTotal());
+#else
+    ASSERTEQUAL(tEnd, machine.strokeStartTicks(1050));
+#endif
+    machine.clearStrokes();
+    ASSERTEQUAL(STATUS_OK, machine.setFeedRate(100, 1050));
 
     MachineThread machThread;
     machThread.setup();
@@ -177,7 +246,7 @@ void test_Machine() {
                 ADCSRA & ((1 << ADEN) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0)));	// ADC 1MHz prescale
     ASSERTEQUAL(0x0000, ADCSRB);	// ADC Control/Status
     ASSERTEQUAL(0x0065, ADMUX);		// Timer/Counter1 active; no prescale
-    ASSERTEQUAL(1, DIDR0 & (1 << ANALOG_SPEED_PIN) ? 1 : 0);	// digital pin disable
+    ASSERTEQUAL(1, DIDR0 & (1 << PC2_ANALOG_SPEED_PIN) ? 1 : 0);	// digital pin disable
     ASSERTEQUAL(0, PRR & PRADC);		// Power Reduction Register; ADC enabled
 #else
     ASSERTEQUAL(0,
@@ -696,13 +765,13 @@ void test_JsonController_stroke(Machine& machine, JsonController &jc) {
         testJSON(machine, jc, replace,
                  "{'systc':'','dvs':{'us':128,'1':[1,2],'2':[4,5],'3':[7,8]}}",
                  "", STATUS_BUSY_MOVING);
-    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.stroke.position());
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.stroke().position());
     ASSERTQUAD(Quad<StepCoord>(5, 5, 5, 5), machine.getMotorPosition());
-    ASSERTEQUAL(tStart, machine.stroke.tStart);
-	ASSERTEQUAL(2, machine.stroke.get_dtTotal());
+    ASSERTEQUAL(tStart, machine.stroke().tStart);
+	ASSERTEQUAL(2, machine.stroke().get_dtTotal());
 	float epsilon = 0.000001;
-    ASSERTEQUALT(0.000128, machine.stroke.getTimePlanned(), epsilon);
-    ASSERTQUAD(Quad<StepCoord>(4, 13, 22, 0), machine.stroke.dEndPos);
+    ASSERTEQUALT(0.000128, machine.stroke().getTimePlanned(), epsilon);
+    ASSERTQUAD(Quad<StepCoord>(4, 13, 22, 0), machine.stroke().dEndPos);
 
 	TCNT1--; // mock ticks() increments TCNT1, so decrement to simulate no change in ticks()
 
@@ -711,18 +780,27 @@ void test_JsonController_stroke(Machine& machine, JsonController &jc) {
     testJSON_process(machine, jc, jcmd, replace, "", STATUS_BUSY_MOVING);
     ASSERTEQUALS("", Serial.output().c_str());
     ASSERTEQUAL(0, digitalRead(PC2_Z_MIN_PIN));
-    ASSERTQUAD(Quad<StepCoord>(1, 4, 7, 0), machine.stroke.position());
+    ASSERTQUAD(Quad<StepCoord>(1, 4, 7, 0), machine.stroke().position());
     ASSERTQUAD(Quad<StepCoord>(6, 9, 12, 5), machine.getMotorPosition()); // axis a NOPIN inactive
     size_t reqAvail = jcmd.requestAvailable();
     size_t resAvail = jcmd.responseAvailable();
 
     // finalize stroke
+#ifdef STEP_ENGINE
+    testJSON_process(machine, jc, jcmd, replace, "", STATUS_BUSY_MOVING);
+    ASSERTQUAD(Quad<StepCoord>(9, 18, 27, 5), machine.getMotorPosition()); // queued pulses
+    test_drain();
+    testJSON_process(machine, jc, jcmd, replace,
+                     "{'s':0,'r':{'systc':105,'dvs':{'us':128,'1':4,'2':13,'3':22}}}\n",
+                     STATUS_OK);
+#else
     testJSON_process(machine, jc, jcmd, replace,
                      "{'s':0,'r':{'systc':103,'dvs':{'us':128,'1':4,'2':13,'3':22}}}\n",
                      STATUS_OK);
-    ASSERTQUAD(Quad<StepCoord>(4, 13, 22, 0), machine.stroke.position());
-    ASSERTQUAD(Quad<StepCoord>(9, 18, 27, 5), machine.getMotorPosition()); // axis a is NOPIN inactive
     ASSERTEQUAL(tStart + 3, threadClock.ticks);
+#endif
+    ASSERTQUAD(Quad<StepCoord>(4, 13, 22, 0), machine.stroke().position());
+    ASSERTQUAD(Quad<StepCoord>(9, 18, 27, 5), machine.getMotorPosition()); // axis a is NOPIN inactive
     ASSERTEQUAL(reqAvail, jcmd.requestAvailable());
     ASSERTEQUAL(resAvail, jcmd.responseAvailable());
 
@@ -734,11 +812,11 @@ void test_JsonController_stroke(Machine& machine, JsonController &jc) {
     jcmd = testJSON(machine, jc, replace,
                     "{'systc':'','dvs':{'us':128,'dp':[10,20],'x':[1,2],'y':[4,5],'z':[7,8]}}",
                     "", STATUS_BUSY_MOVING);
-    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.stroke.position());
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.stroke().position());
     ASSERTQUAD(Quad<StepCoord>(5, 5, 5, 5), machine.getMotorPosition());
-    ASSERTEQUAL(tStart, machine.stroke.tStart);
-    ASSERTEQUAL(2, machine.stroke.getTimePlanned()*TICKS_PER_SECOND);
-    ASSERTQUAD(Quad<StepCoord>(10, 20, 0, 0), machine.stroke.dEndPos);
+    ASSERTEQUAL(tStart, machine.stroke().tStart);
+    ASSERTEQUAL(2, machine.stroke().getTimePlanned()*TICKS_PER_SECOND);
+    ASSERTQUAD(Quad<StepCoord>(10, 20, 0, 0), machine.stroke().dEndPos);
 
 	TCNT1--; // simulate unchanging ticks()
 
@@ -747,18 +825,30 @@ void test_JsonController_stroke(Machine& machine, JsonController &jc) {
     testJSON_process(machine, jc, jcmd, replace, "", STATUS_BUSY_MOVING);
     ASSERTEQUALS("", Serial.output().c_str());
     ASSERTEQUAL(0, digitalRead(PC2_Z_MIN_PIN));
-    ASSERTQUAD(Quad<StepCoord>(1, 4, 7, 0), machine.stroke.position());
+    ASSERTQUAD(Quad<StepCoord>(1, 4, 7, 0), machine.stroke().position());
     ASSERTQUAD(Quad<StepCoord>(6, 9, 12, 5), machine.getMotorPosition()); // axis a NOPIN inactive
     reqAvail = jcmd.requestAvailable();
     resAvail = jcmd.responseAvailable();
 
     // finalize stroke
+#ifdef STEP_ENGINE
+    testJSON_process(machine, jc, jcmd, replace, "", STATUS_BUSY_MOVING);
+    ASSERTQUAD(Quad<StepCoord>(6, 9, 12, 5), machine.getMotorPosition()); // z reverses
+    test_drain();
+    testJSON_process(machine, jc, jcmd, replace, "", STATUS_BUSY_MOVING);
+    ASSERTQUAD(Quad<StepCoord>(15, 25, 5, 5), machine.getMotorPosition()); // queued pulses
+    test_drain();
+    testJSON_process(machine, jc, jcmd, replace,
+                     "{'s':0,'r':{'systc':115,'dvs':{'us':128,'dp':[10,20],'x':10,'y':20,'z':0}}}\n",
+                     STATUS_OK);
+#else
     testJSON_process(machine, jc, jcmd, replace,
                      "{'s':0,'r':{'systc':109,'dvs':{'us':128,'dp':[10,20],'x':10,'y':20,'z':0}}}\n",
                      STATUS_OK);
-    ASSERTQUAD(Quad<StepCoord>(10, 20, 0, 0), machine.stroke.position());
-    ASSERTQUAD(Quad<StepCoord>(15, 25, 5, 5), machine.getMotorPosition()); // axis a is NOPIN inactive
     ASSERTEQUAL(tStart + 3, threadClock.ticks);
+#endif
+    ASSERTQUAD(Quad<StepCoord>(10, 20, 0, 0), machine.stroke().position());
+    ASSERTQUAD(Quad<StepCoord>(15, 25, 5, 5), machine.getMotorPosition()); // axis a is NOPIN inactive
     ASSERTEQUAL(reqAvail, jcmd.requestAvailable());
     ASSERTEQUAL(resAvail, jcmd.responseAvailable());
 
@@ -775,6 +865,103 @@ void test_JsonController_stroke(Machine& machine, JsonController &jc) {
     string jlargein = JT(jlarge.c_str());
     JsonCommand jcmd2;
     ASSERTEQUAL(STATUS_JSON_PARSE_ERROR, jcmd2.parse(jlargein.c_str()));
+
+    // Test base64 packed int8 stroke segments: x:[1,2], y:[4,5], z:[-1,-2]
+    jcmd = testJSON(machine, jc, replace,
+                    "{'dvs':{'us':128,'x':'AQI=','y':'BAU=','z':'//4='}}",
+                    "", STATUS_BUSY_MOVING);
+    ASSERTEQUAL(2, machine.stroke().length);
+    ASSERTQUAD(Quad<StepDV>(1, 4, -1, 0), machine.stroke().seg[0]);
+    ASSERTQUAD(Quad<StepDV>(2, 5, -2, 0), machine.stroke().seg[1]);
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+    testJSON(machine, jc, replace, "{'dvs':{'us':128,'x':'A*I='}}",
+             "{'s':-422,'r':{'dvs':{'us':128,'x':'A*I='}},'e':'x'}\n", STATUS_FIELD_BASE64);
+
+    // Test stroke whose last field is a scalar
+    jcmd = testJSON(machine, jc, replace, "{'dvs':{'x':[1,2],'us':128}}", "", STATUS_BUSY_MOVING);
+    ASSERTEQUAL(2, machine.stroke().length);
+    ASSERTEQUAL(1, machine.stroke().order);
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+    jcmd = testJSON(machine, jc, replace, "{'dvs':{'us':128,'x':[1,2],'so':2}}", "", STATUS_BUSY_MOVING);
+    ASSERTEQUAL(2, machine.stroke().length);
+    ASSERTEQUAL(2, machine.stroke().order);
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+
+    // Test dda strokes need the step engine to space their pulses
+#ifdef STEP_ENGINE
+    jcmd = testJSON(machine, jc, replace, "{'dvs':{'us':128,'x':[1,2],'dda':true}}", "", STATUS_BUSY_MOVING);
+    ASSERT(machine.stroke().dda);
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+#else
+    testJSON(machine, jc, replace, "{'dvs':{'us':128,'x':[1,2],'dda':true}}",
+             "{'s':-210,'r':{'dvs':{'us':128,'x':0,'dda':true}},'e':'dda'}\n", STATUS_STROKE_DDA);
+#endif
+
+    // Test largest base64 stroke fits in MAX_JSON
+    string segs64;
+    for (int i = 0; i < SEGMENT_COUNT; i += 3) {
+        segs64 += "gYGB"; // [-127,-127,-127]
+    }
+    jlarge = "{'dvs':{'us':128,'1':'" + segs64 + "','2':'" + segs64 + 
+		"','3':'" + segs64 + "','4':'" + segs64 + "'}}";
+    ASSERTEQUAL(STATUS_BUSY_PARSED, jcmd2.parse(JT(jlarge.c_str())));
+
+#ifdef STROKE_CACHE_SIZE
+    // Test lin builds line through stroke cache and replays it by id
+    machine.strokeCache.clear();
+    jcmd = testJSON(machine, jc, replace, "{'lin':{'x':100,'id':''}}", "", STATUS_BUSY_MOVING);
+    ASSERTEQUAL(0, machine.strokeCache.hits);
+    ASSERTEQUAL(1, machine.strokeCache.misses);
+    ASSERTQUAD(Quad<StepCoord>(100, 0, 0, 0), machine.stroke().dEndPos);
+    Serial.clear();
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+    ASSERTEQUALS(JT("{'s':-901,'r':{'lin':{'x':100,'id':0}}}\n"), Serial.output().c_str());
+    jcmd = testJSON(machine, jc, replace, "{'lin':{'id':0}}", "", STATUS_BUSY_MOVING);
+    ASSERTEQUAL(1, machine.strokeCache.hits);
+    ASSERTEQUAL(1, machine.strokeCache.misses);
+    ASSERTQUAD(Quad<StepCoord>(100, 0, 0, 0), machine.stroke().dEndPos);
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+    testJSON(machine, jc, replace, "{'lin':{'id':1}}", 
+             "{'s':-207,'r':{'lin':{'id':1}}}\n", STATUS_STROKE_CACHE_ID);
+    testJSON(machine, jc, replace, "{'lin':{'id':256}}", 
+             "{'s':-417,'r':{'lin':{'id':256}},'e':'id'}\n", STATUS_FIELD_RANGE_ERROR);
+    testJSON(machine, jc, replace, "{'sys':{'ch':'','cm':''}}", 
+             "{'s':0,'r':{'sys':{'ch':1,'cm':1}}}\n");
+#else
+    // Test lin builds line without stroke cache
+    jcmd = testJSON(machine, jc, replace, "{'lin':{'x':100}}", "", STATUS_BUSY_MOVING);
+    ASSERTQUAD(Quad<StepCoord>(100, 0, 0, 0), machine.stroke().dEndPos);
+    jc.cancel(jcmd, STATUS_SERIAL_CANCEL);
+    testJSON(machine, jc, replace, "{'lin':{'x':100,'id':''}}", 
+             "{'s':-207,'r':{'lin':{'x':100,'id':''}},'e':'id'}\n", STATUS_STROKE_CACHE_ID);
+#endif
+
+#ifdef STROKE_GENERATOR
+    // Test lin generates a line longer than SEGMENT_COUNT segments on demand
+    machine.setMotorPosition(Quad<StepCoord>());
+    jcmd = testJSON(machine, jc, replace, "{'lin':{'x':6400,'mv':800,'od':true}}", "", STATUS_BUSY_MOVING);
+    ASSERT(SEGMENT_COUNT < machine.lineGenerator.length);
+    ASSERTEQUAL(0, machine.getStrokeCount());
+    ASSERTEQUAL(false, jc.isStroke(jcmd));
+    Status status;
+    StepCoord xPrev = 0;
+    do {
+        status = jc.process(jcmd);
+        ASSERT(xPrev <= machine.getMotorPosition().value[0]);
+        xPrev = machine.getMotorPosition().value[0];
+    } while (status == STATUS_BUSY_MOVING);
+    ASSERTEQUAL(STATUS_OK, status);
+    ASSERTEQUAL(machine.lineGenerator.length, machine.lineGenerator.getGenerated());
+    ASSERTQUAD(Quad<StepCoord>(6400, 0, 0, 0), machine.getMotorPosition());
+    ASSERTEQUALS(JT("{'s':0,'r':{'lin':{'x':6400,'mv':800,'od':true}}}\n"), Serial.output().c_str());
+#ifdef STROKE_CACHE_SIZE
+    testJSON(machine, jc, replace, "{'lin':{'x':100,'id':'','od':true}}", 
+             "{'s':-207,'r':{'lin':{'x':100,'id':-1,'od':true}},'e':'id'}\n", STATUS_STROKE_CACHE_ID);
+#endif
+#else
+    testJSON(machine, jc, replace, "{'lin':{'x':100,'od':true}}", 
+             "{'s':-209,'r':{'lin':{'x':100,'od':true}},'e':'od'}\n", STATUS_STROKE_GENERATOR);
+#endif
 }
 
 void test_JsonController() {
@@ -794,11 +981,30 @@ void test_JsonController() {
     threadClock.ticks = 12345;
     jc.process(jcmd);
     char sysbuf[500];
-    const char *fmt = "{'s':%d,'r':{'sys':{'fr':1000,'jp':false,'lh':false,'lp':0,'pc':2,'tc':12345,'v':%.2f}}}\n";
+#ifdef STROKE_CACHE_SIZE
+    const char *fmt = "{'s':%d,'r':{'sys':{'ch':0,'cm':0,'fo':100,'fr':1000,'jp':false,'lh':false,'li':1,'lp':0,'pc':2,'tc':12345,'v':%.2f}}}\n";
+#else
+    const char *fmt = "{'s':%d,'r':{'sys':{'fo':100,'fr':1000,'jp':false,'lh':false,'li':1,'lp':0,'pc':2,'tc':12345,'v':%.2f}}}\n";
+#endif
     snprintf(sysbuf, sizeof(sysbuf), JT(fmt),
              STATUS_OK, VERSION_MAJOR * 100 + VERSION_MINOR + VERSION_PATCH / 100.0);
     ASSERTEQUALS(sysbuf, Serial.output().c_str());
 
+    // feed rate override
+    JsonCommand jfo;
+    ASSERTEQUAL(STATUS_BUSY_PARSED, jfo.parse(JT("{'sys':{'fo':50}}")));
+    ASSERT(jc.isFeedRate(jfo));
+    jfo.clear();
+    ASSERTEQUAL(STATUS_BUSY_PARSED, jfo.parse(JT("{'sysfo':50,'systc':''}")));
+    ASSERT(!jc.isFeedRate(jfo));
+    testJSON(machine, jc, "'\"", "{'sysfo':50}", "{'s':0,'r':{'sysfo':50}}\n");
+    ASSERTEQUAL(50, machine.getFeedRate());
+    testJSON(machine, jc, "'\"", "{'sysfo':300}",
+             "{'s':-417,'r':{'sysfo':300},'e':'sysfo'}\n", STATUS_FIELD_RANGE_ERROR);
+    ASSERTEQUAL(50, machine.getFeedRate());
+    testJSON(machine, jc, "'\"", "{'sys':{'fo':100}}", "{'s':0,'r':{'sys':{'fo':100}}}\n");
+    ASSERTEQUAL(100, machine.getFeedRate());
+
     test_JsonController_axis(machine, jc, 'x');
     test_JsonController_axis(machine, jc, 'y');
     test_JsonController_axis(machine, jc, 'z');
@@ -862,6 +1068,44 @@ class MockStepper : public QuadStepper {
         }
 };
 
+/**
+ * Reference goalPos() that sums the segments from the stroke start
+ */
+Quad<StepCoord> strokeSumPos(Stroke &stroke, Ticks t) {
+    Quad<StepCoord> dGoal;
+    Ticks dtSegStart = stroke.goalStartTicks(t);
+    Ticks dtSegEnd = stroke.goalEndTicks(t);
+    Ticks dtSeg = dtSegEnd - dtSegStart;
+    Ticks dtTotal = stroke.get_dtTotal();
+    Ticks dt = t - stroke.tStart;
+    if (dt <= 0 || dtTotal <= 0 || stroke.length <= 0 || dtSeg <= 0) {
+        return dGoal;
+    }
+    if (dtTotal <= dt && !stroke.dEndPos.isZero()) {
+        return stroke.dEndPos;
+    }
+    dt = min(dtTotal, min(dtSegEnd, dt));
+    SegIndex sGoal = stroke.goalSegment(t);
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        StepCoord a = 0;
+        StepCoord v = 0;
+        StepCoord pos = 0;
+        for (SegIndex s = 0; s <= sGoal; s++) {
+            StepCoord dv = stroke.scale * (StepCoord) stroke.seg[s].value[i];
+            if (stroke.order == 2) {
+                a += dv;
+                dv = a;
+            }
+            v += dv;
+            if (s < sGoal) {
+                pos += v;
+            }
+        }
+        dGoal.value[i] = pos + ((dt - dtSegStart) * (int32_t)v) / dtSeg;
+    }
+    return dGoal;
+}
+
 void test_Stroke() {
     cout << "TEST	: test_Stroke() =====" << endl;
 
@@ -1029,9 +1273,550 @@ void test_Stroke() {
         }
     }
 
+    // Test goalPos() and goalPosIncremental() against segment summation
+    stroke.clear();
+    for (int i = 0; i < 100; i++) {
+        StepDV dv = (i < 50) ? (StepDV) (i % 7) : (StepDV) -(i % 7);
+        stroke.append( Quad<StepDV>(dv, -dv, 2*dv, (StepDV) (i % 3) - 1) );
+    }
+    stroke.setTimePlanned(1000/(float) TICKS_PER_SECOND);
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    for (Ticks t = tStart - 1; t <= tStart + 1001; t++) {
+        ASSERTQUAD(strokeSumPos(stroke, t), stroke.goalPos(t));
+        ASSERTQUAD(strokeSumPos(stroke, t), stroke.goalPosIncremental(t));
+    }
+    ASSERTQUAD(strokeSumPos(stroke, tStart + 500), stroke.goalPosIncremental(tStart + 500)); // rewind
+    ASSERTQUAD(stroke.dEndPos, stroke.goalPosIncremental(tStart + 1000));
+
+    // Test ProtocolC traversal hands each segment slice over at its start tick
+	stroke.dda = true;
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+	stepper.clear();
+    ASSERTEQUAL(STATUS_BUSY_MOVING, stroke.traverse(tStart - 1, stepper));
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), stepper.dPos);
+    for (Ticks t = tStart; t < tStart + 1000; t++) {
+		ASSERTEQUAL(STATUS_BUSY_MOVING, stroke.traverse(t, stepper));
+		ASSERTQUAD(stepper.dPos, stroke.position());
+		Quad<StepCoord> pos = stroke.goalPos(t);
+		Quad<StepCoord> posNext = stroke.goalPos(t + 1);
+		for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) { // at most a tick and a slice ahead
+			StepCoord ahead = abs(posNext.value[i] - pos.value[i]) + 16;
+			ASSERT(abs(stepper.dPos.value[i] - pos.value[i]) <= ahead);
+		}
+		if ((t - tStart) % 10 == 9) {
+			ASSERTQUAD(stroke.goalPos(t + 1), stepper.dPos); // segment end
+		}
+    }
+    ASSERT(stroke.curSeg < stroke.length);
+    ASSERTEQUAL(STATUS_OK, stroke.traverse(tStart + 1000, stepper));
+    ASSERTQUAD(stroke.dEndPos, stepper.dPos);
+    ASSERTEQUAL(stroke.length, stroke.curSeg);
+
+    // Test second order stroke integrates acceleration deltas twice
+    Stroke stroke2;
+    StepDV da[8] = {1, 0, 0, -1, -1, 0, 0, 1};
+    StepDV dv[8] = {1, 1, 1, 0, -1, -1, -1, 0};
+    stroke.clear();
+    stroke2.order = 2;
+    for (int i = 0; i < 8; i++) {
+        stroke.append( Quad<StepDV>(dv[i], -2*dv[i], 0, 3*dv[i]) );
+        stroke2.append( Quad<StepDV>(da[i], -2*da[i], 0, 3*da[i]) );
+    }
+    stroke.setTimePlanned(80/(float) TICKS_PER_SECOND);
+    stroke2.setTimePlanned(80/(float) TICKS_PER_SECOND);
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTEQUAL(STATUS_OK, stroke2.start(tStart));
+    ASSERTQUAD(Quad<StepCoord>(12, -24, 0, 36), stroke2.dEndPos);
+    for (Ticks t = tStart - 1; t <= tStart + 81; t++) {
+        ASSERTQUAD(stroke.goalPos(t), stroke2.goalPos(t));
+        ASSERTQUAD(strokeSumPos(stroke2, t), stroke2.goalPos(t));
+        ASSERTQUAD(strokeSumPos(stroke2, t), stroke2.goalPosIncremental(t));
+    }
+    ASSERTEQUAL(STATUS_OK, stroke.setOrder(2));
+    ASSERTEQUAL(2, stroke.order);
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        ASSERTQUAD(stroke2.seg[s], stroke.seg[s]);
+    }
+    ASSERTEQUAL(STATUS_OK, stroke.setOrder(1));
+    ASSERTEQUAL(1, stroke.order);
+    ASSERTQUAD(Quad<StepDV>(dv[3], -2*dv[3], 0, 3*dv[3]), stroke.seg[3]);
+
+    // Test feed rate override keeps position continuous
+    Ticks dt0 = stroke2.get_dtTotal();
+    Ticks t1 = tStart + dt0 / 2;
+    Quad<StepCoord> pos = stroke2.goalPos(t1);
+    stroke2.setFeedRate(t1, 50);
+    ASSERTEQUAL(2 * dt0, stroke2.get_dtTotal());
+    ASSERTEQUAL(t1 - 2 * (dt0 / 2), stroke2.tStart);
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) { // within tick rounding
+        ASSERT(abs(pos.value[i] - stroke2.goalPos(t1).value[i]) <= 1);
+    }
+    ASSERTQUAD(stroke2.goalPos(t1), stroke2.goalPosIncremental(t1));
+    stroke2.setFeedRate(t1, 200);
+    ASSERTEQUAL(dt0 / 2, stroke2.get_dtTotal());
+    ASSERT(stroke2.tStart < t1);
+    ASSERT(t1 < stroke2.tStart + stroke2.get_dtTotal());
+    ASSERTQUAD(stroke2.dEndPos, stroke2.goalPos(stroke2.tStart + stroke2.get_dtTotal()));
+    stroke2.setFeedRate(stroke2.tStart + stroke2.get_dtTotal(), 100); // done strokes keep tStart
+    ASSERTEQUAL(dt0, stroke2.get_dtTotal());
+    ASSERTEQUAL(1, stroke2.getTimePlanned() * TICKS_PER_SECOND / dt0);
+
+    // Test polyline blends corners without stopping at waypoints
+    StrokeBuilder sb(12800, 0.5, 0, 100);
+    Quad<StepCoord> waypoints[] = {
+        Quad<StepCoord>(1000, 0, 0, 0),
+        Quad<StepCoord>(1000, 1000, 0, 0),
+        Quad<StepCoord>(2000, 1000, 500, 0),
+    };
+    ASSERTEQUAL(STATUS_OK, sb.buildPolyline(stroke, waypoints, 3));
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(waypoints[2], stroke.dEndPos);
+    Ticks dtSeg = stroke.get_dtTotal() / stroke.length;
+    Quad<StepCoord> posPrev;
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        Quad<StepCoord> pos = stroke.goalPos(tStart + ((s + 1) * stroke.get_dtTotal()) / stroke.length);
+        Quad<StepCoord> v = pos - posPrev;
+        StepCoord speed = 0;
+        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+            speed = max(speed, (StepCoord) abs(v.value[i]));
+            ASSERT(abs(v.value[i]) <= (12800 * (dtSeg + 1)) / TICKS_PER_SECOND + 1);
+        }
+        if (0 < s && s < stroke.length - 1) {
+            ASSERT(speed > 0); // no intermediate stop
+        }
+        posPrev = pos;
+    }
+    ASSERTEQUAL(STATUS_STROKE_NULL_ERROR, sb.buildPolyline(stroke, waypoints, 0));
+
+    // Test polyline stretches planned time so that segment rounding keeps
+    // each motor within its motorVMax
+    StrokeBuilder sbLimit(12800, 0.01, 0, 100);
+    sbLimit.motorVMax[2] = 20;
+    Quad<StepCoord> waypointsLimit[] = {
+        Quad<StepCoord>(1000, 0, 0, 0),
+        Quad<StepCoord>(1000, 1000, 3, 0),
+    };
+    ASSERTEQUAL(STATUS_OK, sbLimit.buildPolyline(stroke, waypointsLimit, 2));
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(waypointsLimit[1], stroke.dEndPos);
+    dtSeg = stroke.get_dtTotal() / stroke.length;
+    posPrev = Quad<StepCoord>();
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        Quad<StepCoord> pos = stroke.goalPos(tStart + ((s + 1) * stroke.get_dtTotal()) / stroke.length);
+        ASSERT(abs(pos.value[2] - posPrev.value[2]) * TICKS_PER_SECOND <= 20 * (dtSeg + 1));
+        posPrev = pos;
+    }
+
+    // Test polyline with few segments scales segments that overflow StepDV
+    StrokeBuilder sbScale(12800, 0.5, 8, 8);
+    Quad<StepCoord> waypointsScale[] = {
+        Quad<StepCoord>(3000, 0, 0, 0),
+        Quad<StepCoord>(3000, 3000, 0, 0),
+    };
+    ASSERTEQUAL(STATUS_OK, sbScale.buildPolyline(stroke, waypointsScale, 2));
+    ASSERTEQUAL(8, stroke.length);
+    ASSERT(stroke.scale > 1);
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(waypointsScale[1], stroke.dEndPos);
+    ASSERTQUAD(waypointsScale[1], stroke.goalPos(tStart + stroke.get_dtTotal()));
+    posPrev = Quad<StepCoord>();
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        Quad<StepCoord> pos = stroke.goalPos(tStart + ((s + 1) * stroke.get_dtTotal()) / stroke.length);
+        ASSERT(posPrev.value[0] <= pos.value[0]);
+        ASSERT(posPrev.value[1] <= pos.value[1]);
+        posPrev = pos;
+    }
+
+    // Test adaptive segment count is the smallest acceptable one from
+    // minSegments, even though deviation is not monotone in the count
+    int nonMonotone = 0;
+    StepCoord xAdapt[] = {500, 1000, 3000, 6400};
+    for (int ix = 0; ix < 4; ix++) {
+        Quad<StepCoord> relAdapt(xAdapt[ix], -xAdapt[ix]/3, xAdapt[ix]/5, 0);
+        for (StepCoord d = 1; d <= 3; d++) {
+            StrokeBuilder sbSmallest(12800, 0.5, 4, 80, d);
+            ASSERTEQUAL(STATUS_OK, sbSmallest.buildLine(stroke, relAdapt));
+            for (int16_t n = 4; n <= 80; n++) {
+                StrokeBuilder sbN(12800, 0.5, n, n, d);
+                Status status = sbN.buildLine(stroke2, relAdapt);
+                if (n < stroke.length) {
+                    ASSERTEQUAL(STATUS_STROKE_DEVIATION, status);
+                } else if (n == stroke.length) {
+                    ASSERTEQUAL(STATUS_OK, status);
+                } else if (status == STATUS_STROKE_DEVIATION) {
+                    nonMonotone++;
+                }
+            }
+        }
+    }
+    ASSERT(nonMonotone > 0);
+    StrokeBuilder sbMin(12800, 0.5, 30, 80, 3);
+    ASSERTEQUAL(STATUS_OK, sbMin.buildLine(stroke, Quad<StepCoord>(500, -166, 100, 0)));
+    ASSERTEQUAL(30, stroke.length);
+
+    // Test adaptive segment count stays near the PH5 line with fewer segments
+    StrokeBuilder sbFixed(12800, 0.5, 20, 100);
+    StrokeBuilder sbAdapt(12800, 0.5, 4, 100, 2);
+    Quad<StepCoord> relPos(300, -200, 100, 0);
+    ASSERTEQUAL(STATUS_OK, sbFixed.buildLine(stroke, relPos));
+    ASSERTEQUAL(STATUS_OK, sbAdapt.buildLine(stroke2, relPos));
+    ASSERT(stroke2.length < stroke.length);
+    ASSERTEQUAL(stroke.get_dtTotal(), stroke2.get_dtTotal());
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTEQUAL(STATUS_OK, stroke2.start(tStart));
+    ASSERTQUAD(relPos, stroke2.dEndPos);
+    for (Ticks t = tStart; t <= tStart + stroke.get_dtTotal(); t++) {
+        Quad<StepCoord> pos = stroke.goalPos(t);
+        Quad<StepCoord> pos2 = stroke2.goalPos(t);
+        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) { // fixed stroke is within 1 pulse of PH5
+            ASSERT(abs(pos.value[i] - pos2.value[i]) <= 2 + 1);
+        }
+    }
+    relPos = Quad<StepCoord>(20000, 0, 0, 0);
+    sbFixed.maxSegments = 20;
+    ASSERTEQUAL(STATUS_OK, sbFixed.buildLine(stroke, relPos));
+    ASSERTEQUAL(20, stroke.length);
+    ASSERT(stroke.scale > 1);
+    sbAdapt.maxSegments = SEGMENT_COUNT - 1;
+    ASSERTEQUAL(STATUS_OK, sbAdapt.buildLine(stroke2, relPos));
+    ASSERT(stroke2.length > 20 || stroke2.scale > 1);
+    sbAdapt.maxSegments = 3;
+    ASSERTEQUAL(STATUS_STROKE_DEVIATION, sbAdapt.buildLine(stroke2, Quad<StepCoord>(300, -200, 100, 0)));
+
+    // Test automatic scale reaches the exact end position
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(relPos, stroke.dEndPos);
+    ASSERTQUAD(relPos, stroke.goalPos(tStart + stroke.get_dtTotal()));
+    Quad<StepCoord> posEnd = stroke.goalPos(tStart + stroke.get_dtTotal() - 1);
+    ASSERT(abs(relPos.value[0] - posEnd.value[0]) <= stroke.maxEndPulses);
+    posPrev = Quad<StepCoord>();
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        Quad<StepCoord> pos = stroke.goalPos(tStart + ((s + 1) * stroke.get_dtTotal()) / stroke.length);
+        ASSERT(posPrev.value[0] <= pos.value[0]); // no backlash from rounding
+        posPrev = pos;
+    }
+#ifdef STROKE_CACHE_SIZE
+    StrokeCache cache;
+    int8_t id;
+    ASSERTEQUAL(STATUS_OK, cache.buildLine(sbFixed, stroke2, relPos, id));
+    ASSERTEQUAL(STATUS_OK, cache.load(id, stroke2));
+    ASSERTEQUAL(stroke.scale, stroke2.scale);
+    ASSERTQUAD(relPos, stroke2.dEndPos);
+#endif
+
+    // Test per-motor velocity limits only slow lines that move the binding motor
+    StrokeBuilder sbLim(12800, 0.5, 20, 100);
+    relPos = Quad<StepCoord>(1000, 100, 0, 0);
+    ASSERTEQUAL(12800, sbLim.lineVMax(relPos));
+    ASSERTEQUAL(STATUS_OK, sbLim.buildLine(stroke, relPos));
+    sbLim.motorVMax[2] = 10; // idle motor
+    sbLim.motorVMax[0] = 20000; // faster than vMax
+    ASSERTEQUAL(12800, sbLim.lineVMax(relPos));
+    ASSERTEQUAL(STATUS_OK, sbLim.buildLine(stroke2, relPos));
+    ASSERTEQUAL(stroke.get_dtTotal(), stroke2.get_dtTotal());
+    sbLim.motorVMax[1] = 1000; // slow motor binds at 10x dominant velocity
+    ASSERTEQUAL(10000, sbLim.lineVMax(relPos));
+    ASSERTEQUAL(STATUS_OK, sbLim.buildLine(stroke2, relPos));
+    ASSERT(stroke.get_dtTotal() < stroke2.get_dtTotal());
+    Machine machine;
+    machine.getMotorAxis(1).usDelay = 80;
+    machine.setStrokeLimits(sbLim);
+    ASSERTEQUAL(0, sbLim.motorVMax[0]);
+    ASSERTEQUAL(12500, sbLim.motorVMax[1]);
+
+    // Test arc stays on its circle and helix advances with the arc
+    StrokeBuilder sbArc(12800, 0.5, 40, 40);
+    ASSERTEQUAL(STATUS_OK, sbArc.buildArc(stroke, Quad<StepCoord>(1000, 0, 0, 0), M_PI / 2));
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(Quad<StepCoord>(1000, -1000, 0, 0), stroke.dEndPos);
+    ASSERTEQUAL(STATUS_OK, sbArc.buildArc(stroke, Quad<StepCoord>(1000, 0, 0, 0), -M_PI / 2));
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(Quad<StepCoord>(1000, 1000, 0, 0), stroke.dEndPos);
+    ASSERTEQUAL(STATUS_OK, sbArc.buildArc(stroke, Quad<StepCoord>(-600, 800, 0, 0), 2 * M_PI,
+                Quad<StepCoord>(0, 0, 800, 0)));
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 800, 0), stroke.dEndPos);
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        Quad<StepCoord> pos = stroke.goalPos(tStart + ((s + 1) * stroke.get_dtTotal()) / stroke.length);
+        float r = sqrt((float)(pos.value[0] + 600) * (pos.value[0] + 600) +
+                       (float)(pos.value[1] - 800) * (pos.value[1] - 800));
+        ASSERT(abs(r - 1000) <= 2);
+    }
+    Quad<StepCoord> posHalf = stroke.goalPos(tStart + stroke.get_dtTotal() / 2);
+    ASSERTQUAD(Quad<StepCoord>(-1200, 1600, 400, 0), posHalf);
+    ASSERTEQUAL(STATUS_STROKE_NULL_ERROR, sbArc.buildArc(stroke, Quad<StepCoord>(), M_PI));
+    relPos = Quad<StepCoord>(100, 0, 0, 0);
+    ASSERTEQUAL(STATUS_OK, sbFixed.buildLine(stroke, relPos));
+    ASSERTEQUAL(1, stroke.scale); // smallest scale
+    ASSERTQUAD(Quad<StepCoord>(), stroke.dEndPos);
+
+    // Long slow generated lines overflow dt * length
+    StrokeBuilder sbSlow(100, 0.5, 20, 50);
+    StrokeGenerator sgSlow(sbSlow, Quad<StepCoord>(30000, 0, 0, 0));
+    ASSERT(sgSlow.dtTotal > INT32_MAX / sgSlow.length);
+    ASSERTEQUAL(STATUS_OK, sgSlow.start(tStart));
+    StepCoord xPrev = 0;
+    for (Ticks dt = 0; dt < sgSlow.dtTotal; dt += sgSlow.dtTotal / 997) {
+        Quad<StepCoord> pos = sgSlow.goalPos(tStart + dt);
+        ASSERTEQUAL((int16_t)(((int64_t) dt * sgSlow.length) / sgSlow.dtTotal), sgSlow.curSeg);
+        ASSERT(xPrev <= pos.value[0] && pos.value[0] <= 30000);
+        xPrev = pos.value[0];
+    }
+    ASSERTQUAD(Quad<StepCoord>(30000, 0, 0, 0), sgSlow.goalPos(tStart + sgSlow.dtTotal));
+
+    // Second order segments of a built line need fewer dvs characters
+    StrokeBuilder sbOrder(12800, 0.5, 50, 50);
+    ASSERTEQUAL(STATUS_OK, sbOrder.buildLine(stroke, Quad<StepCoord>(6400, 3200, 0, 0)));
+    stroke2 = stroke;
+    ASSERTEQUAL(STATUS_OK, stroke2.setOrder(2));
+    int chars1 = 0;
+    int chars2 = 0;
+    char segText[8];
+    for (SegIndex s = 0; s < stroke.length; s++) {
+        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+            chars1 += snprintf(segText, sizeof(segText), "%d,", stroke.seg[s].value[i]);
+            chars2 += snprintf(segText, sizeof(segText), "%d,", stroke2.seg[s].value[i]);
+        }
+    }
+    ASSERT(chars2 < chars1);
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTEQUAL(STATUS_OK, stroke2.start(tStart));
+    for (Ticks t = tStart; t <= tStart + stroke.get_dtTotal(); t++) {
+        ASSERTQUAD(stroke.goalPos(t), stroke2.goalPos(t));
+    }
+    stroke.clear();
+    stroke.append(Quad<StepDV>(100, 0, 0, 0));
+    stroke.append(Quad<StepDV>(-100, 0, 0, 0));
+    ASSERTEQUAL(STATUS_STROKE_SEGPULSES, stroke.setOrder(2)); // -200 does not fit
+    ASSERTEQUAL(1, stroke.order);
+    ASSERTQUAD(Quad<StepDV>(-100, 0, 0, 0), stroke.seg[1]);
+
     cout << "TEST	: test_Stroke() OK " << endl;
 }
 
+void test_DeltaCalculator() {
+    cout << "TEST	: test_DeltaCalculator() =====" << endl;
+
+    DeltaCalculator delta;
+    Quad<StepCoord> pulses;
+    ASSERTEQUALT(83.333, delta.getDegreePulses(), 0.001);
+    ASSERTEQUAL(STATUS_OK, delta.calcPulses(XYZ(0, 0, -250), pulses));
+    ASSERTQUAD(Quad<StepCoord>(111, 111, 111, 0), pulses);
+    ASSERTEQUAL(STATUS_OK, delta.calcPulses(XYZ(50, 0, -250), pulses));
+    ASSERTQUAD(Quad<StepCoord>(376, -604, 1332, 0), pulses);
+    ASSERTEQUAL(STATUS_KINEMATIC_XYZ, delta.calcPulses(XYZ(0, 0, -100), pulses));
+    ASSERTEQUAL(STATUS_KINEMATIC_XYZ, delta.calcPulses(XYZ(0, 0, 0), pulses));
+
+    // Cartesian line follows inverse kinematics, not a motor line
+    StrokeBuilder sb(12800, 0.5, 20, 20);
+    Stroke stroke;
+    ASSERTEQUAL(STATUS_OK, sb.buildDeltaLine(stroke, delta, XYZ(0, 0, -250), XYZ(50, 0, -250)));
+    ASSERTEQUAL(20, stroke.length);
+    Ticks tStart = 100000;
+    ASSERTEQUAL(STATUS_OK, stroke.start(tStart));
+    ASSERTQUAD(Quad<StepCoord>(376 - 111, -604 - 111, 1332 - 111, 0), stroke.dEndPos);
+    Quad<StepCoord> posMid = stroke.goalPos(tStart + stroke.get_dtTotal() / 2);
+    Quad<StepCoord> ikMid(177 - 111, -314 - 111, 664 - 111, 0); // IK of (25,0,-250)
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        ASSERT(abs(ikMid.value[i] - posMid.value[i]) <= 3);
+    }
+    ASSERTEQUAL(STATUS_KINEMATIC_XYZ, sb.buildDeltaLine(stroke, delta, XYZ(0, 0, -250), XYZ(0, 0, -100)));
+
+    cout << "TEST	: test_DeltaCalculator() OK " << endl;
+}
+
+void test_StrokeCache() {
+    cout << "TEST	: test_StrokeCache() =====" << endl;
+
+#ifdef STROKE_CACHE_SIZE
+    StrokeCache cache;
+    StrokeBuilder sb(12800, 0.7, 0, 0);
+    Stroke stroke;
+    Stroke strokeRef;
+    Quad<StepCoord> relPos(3200, -1600, 800, 0);
+    int8_t id = -1;
+
+    // miss builds and caches line
+    ASSERTEQUAL(STATUS_OK, cache.buildLine(sb, stroke, relPos, id));
+    ASSERTEQUAL(0, id);
+    ASSERTEQUAL(0, cache.hits);
+    ASSERTEQUAL(1, cache.misses);
+
+    // hit copies cached line
+    ASSERTEQUAL(STATUS_OK, sb.buildLine(strokeRef, relPos));
+    stroke.clear();
+    ASSERTEQUAL(STATUS_OK, cache.buildLine(sb, stroke, relPos, id));
+    ASSERTEQUAL(0, id);
+    ASSERTEQUAL(1, cache.hits);
+    ASSERTEQUAL(1, cache.misses);
+    ASSERTEQUAL(strokeRef.length, stroke.length);
+    ASSERTEQUAL(strokeRef.get_dtTotal(), stroke.get_dtTotal());
+    ASSERTEQUAL(strokeRef.vPeak, stroke.vPeak);
+    ASSERTEQUAL(0, memcmp(strokeRef.seg, stroke.seg, stroke.length * sizeof(Quad<StepDV>)));
+    ASSERTEQUAL(STATUS_OK, stroke.start(1));
+    ASSERTQUAD(relPos, stroke.dEndPos);
+
+    // builder settings are part of the key
+    sb.vMax = 16000;
+    ASSERTEQUAL(STATUS_OK, cache.buildLine(sb, stroke, relPos, id));
+    ASSERTEQUAL(1, id);
+    ASSERTEQUAL(2, cache.misses);
+    sb.vMax = 12800;
+    ASSERTEQUAL(0, cache.find(sb, relPos));
+    ASSERTEQUAL(-1, cache.find(sb, Quad<StepCoord>(3200, -1600, 800, 1)));
+
+    // oldest line is replaced
+    ASSERTEQUAL(STATUS_OK, cache.buildLine(sb, stroke, Quad<StepCoord>(100, 0, 0, 0), id));
+    ASSERTEQUAL(0, id);
+    ASSERTEQUAL(-1, cache.find(sb, relPos));
+
+    // replay by id
+    ASSERTEQUAL(STATUS_OK, cache.load(0, stroke));
+    ASSERTEQUAL(STATUS_OK, stroke.start(1));
+    ASSERTQUAD(Quad<StepCoord>(100, 0, 0, 0), stroke.dEndPos);
+    ASSERTEQUAL(STATUS_STROKE_CACHE_ID, cache.load(-1, stroke));
+    ASSERTEQUAL(STATUS_STROKE_CACHE_ID, cache.load(STROKE_CACHE_SIZE, stroke));
+    cache.clear();
+    ASSERTEQUAL(STATUS_STROKE_CACHE_ID, cache.load(0, stroke));
+    ASSERTEQUAL(0, cache.hits);
+    ASSERTEQUAL(0, cache.misses);
+#endif
+
+    cout << "TEST	: test_StrokeCache() OK " << endl;
+}
+
+void test_StepEngine() {
+    cout << "TEST	: test_StepEngine() =====" << endl;
+
+	arduino.clear();
+	threadRunner.clear();
+	TIMER_SETUP();
+	TIMER_ENABLE(true);
+    Machine machine;
+    machine.enable(true);
+    machine.setMotorPosition(Quad<StepCoord>(1000, 1000, 1000, 0));
+    arduino.setPin(PC2_X_MIN_PIN, 0);
+    arduino.setPin(PC2_Y_MIN_PIN, 0);
+    arduino.setPin(PC2_Z_MIN_PIN, 0);
+    uint32_t xPulses = arduino.pulses(PC2_X_STEP_PIN);
+    uint32_t yPulses = arduino.pulses(PC2_Y_STEP_PIN);
+    uint32_t zPulses = arduino.pulses(PC2_Z_STEP_PIN);
+    StepEngine engine;
+	engine.setup(machine, machine.getStepPorts());
+	ASSERT(engine.isIdle());
+
+	// pulses are queued for the ISR, which writes the step pin ports
+	Ticks t0 = ticks();
+	Quad<StepDV> pulse(4, 0, -2, 0);
+	ASSERTEQUAL(STATUS_OK, engine.stepDirection(pulse));
+	ASSERTEQUAL(STATUS_OK, engine.stepFast(pulse));
+	ASSERTEQUAL(4, engine.getQueued());
+	ASSERTQUAD(Quad<StepCoord>(1004, 1000, 998, 0), machine.getMotorPosition());
+	ASSERTEQUAL(xPulses + 0, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(zPulses + 0, arduino.pulses(PC2_Z_STEP_PIN));
+	arduino.timer1(7);
+	ASSERT(engine.isIdle());
+	ASSERTEQUAL(xPulses + 4, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(yPulses + 0, arduino.pulses(PC2_Y_STEP_PIN));
+	ASSERTEQUAL(zPulses + 2, arduino.pulses(PC2_Z_STEP_PIN));
+
+	// pulses are spread evenly over the interval between planner samples
+	Ticks t1 = ticks();
+	ASSERTEQUAL(t0 + 8, t1);
+	pulse = Quad<StepDV>(8, 4, 0, 0);
+	ASSERTEQUAL(STATUS_OK, engine.stepDirection(pulse));
+	ASSERTEQUAL(STATUS_OK, engine.stepFast(pulse));
+	ASSERTEQUAL(8, engine.getQueued());
+	arduino.timer1(1);
+	ASSERTEQUAL(xPulses + 6, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(yPulses + 1, arduino.pulses(PC2_Y_STEP_PIN));
+	arduino.timer1(2);
+	ASSERTEQUAL(xPulses + 8, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(yPulses + 2, arduino.pulses(PC2_Y_STEP_PIN));
+	arduino.timer1(4);
+	ASSERTEQUAL(xPulses + 12, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(yPulses + 4, arduino.pulses(PC2_Y_STEP_PIN));
+	ASSERT(engine.isIdle());
+
+	// planner retries when the queue has no room for a pulse block
+	ticks();
+	pulse = Quad<StepDV>(40, 0, 0, 0);
+	ASSERTEQUAL(STATUS_OK, engine.stepDirection(pulse));
+	ASSERTEQUAL(STATUS_OK, engine.stepFast(pulse));
+	ASSERTEQUAL(STATUS_BUSY, engine.stepDirection(pulse));
+	ASSERTQUAD(Quad<StepCoord>(1052, 1004, 998, 0), machine.getMotorPosition());
+	arduino.timer1(STEPENGINE_MAXDT + 1);
+	ASSERT(engine.isIdle());
+	ASSERTEQUAL(xPulses + 52, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(STATUS_OK, engine.stepDirection(pulse));
+	ASSERTEQUAL(STATUS_OK, engine.stepFast(pulse));
+	ASSERTEQUAL(STATUS_STEP_RANGE_ERROR, engine.stepDirection(Quad<StepDV>(STEPQUEUE_SIZE, 0, 0, 0)));
+	arduino.timer1(STEPENGINE_MAXDT + 1);
+	ASSERT(engine.isIdle());
+	ASSERTEQUAL(xPulses + 92, arduino.pulses(PC2_X_STEP_PIN));
+
+	// a motor reverses only after its queued pulses are emitted
+	ticks();
+	pulse = Quad<StepDV>(2, 0, 0, 0);
+	ASSERTEQUAL(STATUS_OK, engine.stepDirection(pulse));
+	ASSERTEQUAL(STATUS_OK, engine.stepFast(pulse));
+	pulse = Quad<StepDV>(-2, 0, 0, 0);
+	ASSERTEQUAL(STATUS_BUSY, engine.stepDirection(pulse));
+	ASSERTQUAD(Quad<StepCoord>(1094, 1004, 998, 0), machine.getMotorPosition());
+	arduino.timer1(STEPENGINE_MAXDT + 1);
+	ASSERT(engine.isIdle());
+	ASSERTEQUAL(STATUS_OK, engine.stepDirection(pulse));
+	ASSERTQUAD(Quad<StepCoord>(1092, 1004, 998, 0), machine.getMotorPosition());
+	ASSERTEQUAL(STATUS_OK, engine.stepFast(pulse));
+	arduino.timer1(STEPENGINE_MAXDT + 1);
+	ASSERT(engine.isIdle());
+	ASSERTEQUAL(xPulses + 96, arduino.pulses(PC2_X_STEP_PIN));
+
+	// ProtocolC segment pulses are spread evenly over the segment
+	ticks();
+	ASSERTEQUAL(STATUS_OK, engine.stepSegment(Quad<StepCoord>(4, 0, 2, 0), 8));
+	ASSERTEQUAL(4, engine.getQueued());
+	arduino.timer1(1);
+	ASSERTEQUAL(xPulses + 97, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(zPulses + 3, arduino.pulses(PC2_Z_STEP_PIN));
+	arduino.timer1(2);
+	ASSERTEQUAL(xPulses + 98, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(zPulses + 3, arduino.pulses(PC2_Z_STEP_PIN));
+	arduino.timer1(4);
+	ASSERTEQUAL(xPulses + 100, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTEQUAL(zPulses + 4, arduino.pulses(PC2_Z_STEP_PIN));
+	ASSERT(engine.isIdle());
+	ASSERTQUAD(Quad<StepCoord>(1096, 1004, 1000, 0), machine.getMotorPosition());
+
+	// dda stroke slices are spread evenly instead of emitted in bursts
+	Stroke stroke;
+	stroke.append(Quad<StepDV>(20, 0, 0, 0));
+	stroke.append(Quad<StepDV>(0, 0, 0, 0));
+	stroke.append(Quad<StepDV>(0, 0, 0, 0));
+	stroke.append(Quad<StepDV>(-20, 0, 0, 0));
+	stroke.setTimePlanned(160 / (float) TICKS_PER_SECOND);
+	stroke.dda = true;
+	ASSERTEQUAL(STATUS_OK, stroke.start(ticks()));
+	Status status;
+	do {
+		uint32_t xTick = arduino.pulses(PC2_X_STEP_PIN);
+		status = stroke.traverse(ticks(), engine);
+		ASSERT(status == STATUS_OK || status == STATUS_BUSY_MOVING);
+		ASSERT(arduino.pulses(PC2_X_STEP_PIN) - xTick <= 2); // a 10 pulse slice takes 20 ticks
+	} while (status == STATUS_BUSY_MOVING || !engine.isIdle());
+	ASSERTEQUAL(xPulses + 160, arduino.pulses(PC2_X_STEP_PIN));
+	ASSERTQUAD(Quad<StepCoord>(1156, 1004, 1000, 0), machine.getMotorPosition());
+
+	// target errors are returned when pulses are queued
+	machine.axis[0].enable(false);
+	pulse = Quad<StepDV>(2, 0, 0, 0);
+	ASSERTEQUAL(STATUS_AXIS_DISABLED, engine.stepDirection(pulse));
+	ASSERT(engine.isIdle());
+	ASSERTQUAD(Quad<StepCoord>(1156, 1004, 1000, 0), machine.getMotorPosition());
+
+    cout << "TEST	: test_StepEngine() OK " << endl;
+}
+
 void test_Machine_step() {
     cout << "TEST	: test_Machine_step() =====" << endl;
 
@@ -1115,6 +1900,38 @@ void test_Machine_step() {
     ASSERTEQUAL(STATUS_LIMIT_MIN, machine.step(Quad<StepDV>(-1, -1, -1, 0)));
     ASSERTQUAD(Quad<StepCoord>(2, 1, 0, 0), machine.getMotorPosition());
 
+    // Test travel checked stroke
+    arduino.setPin(machine.axis[0].pinMin, 0);
+    machine.axis[0].readAtMin(machine.invertLim);
+    Stroke &stroke = *machine.strokeBuffer();
+    stroke.clear();
+    stroke.seg[0] = Quad<StepDV>(3, -1, 0, 0);
+    stroke.seg[1] = Quad<StepDV>(-6, 0, 0, 0);
+    stroke.length = 2;
+    stroke.setTimePlanned(1);
+    ASSERTEQUAL(STATUS_OK, stroke.start(0));
+    ASSERTQUAD(Quad<StepCoord>(0, -2, 0, 0), stroke.dPosMin);
+    ASSERTQUAD(Quad<StepCoord>(3, 0, 0, 0), stroke.dPosMax);
+    ASSERTEQUAL(false, stroke.travelChecked);
+    machine.axis[0].travelMax = 4;
+    ASSERTEQUAL(STATUS_TRAVEL_MAX, machine.checkStrokeTravel(stroke));
+    ASSERTEQUAL(false, stroke.travelChecked);
+    machine.axis[0].travelMax = 5;
+    machine.axis[1].travelMin = 0;
+    ASSERTEQUAL(STATUS_TRAVEL_MIN, machine.checkStrokeTravel(stroke));
+    machine.axis[1].travelMin = -10;
+    ASSERTEQUAL(STATUS_OK, machine.checkStrokeTravel(stroke));
+    ASSERTEQUAL(true, stroke.travelChecked);
+    machine.queueStroke();
+    ASSERTEQUAL(STATUS_OK, machine.stepDirection(Quad<StepDV>(3, -1, 0, 0)));
+    ASSERTQUAD(Quad<StepCoord>(5, 0, 0, 0), machine.getMotorPosition());
+    machine.limitPoll = 2;
+    arduino.setPin(machine.axis[0].pinMin, 1);
+    ASSERTEQUAL(STATUS_OK, machine.stepDirection(Quad<StepDV>(-1, 0, 0, 0)));
+    ASSERTEQUAL(STATUS_LIMIT_MIN, machine.stepDirection(Quad<StepDV>(-1, 0, 0, 0)));
+    ASSERTQUAD(Quad<StepCoord>(4, 0, 0, 0), machine.getMotorPosition());
+    machine.clearStrokes();
+
     cout << "TEST	: test_Machine_step() OK " << endl;
 }
 
@@ -1153,6 +1970,114 @@ void test_PinConfig() {
     cout << "TEST	: test_PinConfig() OK " << endl;
 }
 
+void test_moveDelta() {
+    cout << "TEST	: test_moveDelta() =====" << endl;
+
+    arduino.clear();
+    arduino.setPin(PC2_X_MIN_PIN, 0);
+    arduino.setPin(PC2_Y_MIN_PIN, 0);
+    arduino.setPin(PC2_Z_MIN_PIN, 0);
+    Machine machine;
+    machine.enable(true);
+    for (MotorIndex i = 0; i < 3; i++) {
+        machine.axis[i].travelMin = -1000;
+        machine.axis[i].travelMax = 1000;
+    }
+    int32_t xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    int32_t ypulses = arduino.pulses(PC2_Y_STEP_PIN);
+    int32_t zpulses = arduino.pulses(PC2_Z_STEP_PIN);
+
+    // every component negative
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveDelta(Quad<StepCoord>(-3, -10, -7, 0), 0));
+    ASSERTQUAD(Quad<StepCoord>(-3, -10, -7, 0), machine.getMotorPosition());
+    ASSERTEQUAL(xpulses + 3, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses + 10, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(zpulses + 7, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_Y_DIR_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_Z_DIR_PIN));
+
+    // mixed signs with a negative dominant axis
+    int32_t xdirpulses = arduino.pulses(PC2_X_DIR_PIN);
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveDelta(Quad<StepCoord>(5, -8, 2, 0), 0));
+    ASSERTQUAD(Quad<StepCoord>(2, -18, -5, 0), machine.getMotorPosition());
+    ASSERTEQUAL(xpulses + 8, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses + 18, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(zpulses + 9, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERTEQUAL(HIGH, arduino.getPin(PC2_X_DIR_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_Y_DIR_PIN));
+    ASSERTEQUAL(HIGH, arduino.getPin(PC2_Z_DIR_PIN));
+    ASSERTEQUAL(xdirpulses, arduino.pulses(PC2_X_DIR_PIN)); // direction set once
+
+    // travel limit stops all axes part way along the line
+    machine.axis[0].travelMax = 5;
+    ASSERTEQUAL(STATUS_TRAVEL_MAX, machine.moveDelta(Quad<StepCoord>(8, 4, 0, 0), 0));
+    ASSERTEQUAL(5, machine.axis[0].position);
+    ASSERTEQUALT(-18 + 2, machine.axis[1].position, 1);
+    ASSERTEQUAL(xpulses + 11, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses + 18 + machine.axis[1].position + 18, arduino.pulses(PC2_Y_STEP_PIN));
+    machine.axis[0].travelMax = 1000;
+
+    // requested time is filled after the last step
+    ASSERTEQUAL(STATUS_OK, machine.moveDelta(Quad<StepCoord>(), 1));
+    int32_t usStart = delayMicsTotal;
+    machine.axis[1].usDelay = 100;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveDelta(Quad<StepCoord>(0, 100, 0, 0), 0.5));
+    ASSERTEQUAL(usStart + 500000, delayMicsTotal);
+    usStart = delayMicsTotal;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveDelta(Quad<StepCoord>(0, -100, 0, 0), 0));
+    ASSERTEQUAL(usStart + 100 * 100, delayMicsTotal);
+    machine.axis[1].usDelay = 0;
+
+    ASSERTEQUAL(STATUS_AXIS_DISABLED, machine.moveDelta(Quad<StepCoord>(1, 0, 0, 1), 0));
+
+    cout << "TEST	: test_moveDelta() OK " << endl;
+}
+
+void test_pulse() {
+    cout << "TEST	: test_pulse() =====" << endl;
+
+    arduino.clear();
+    arduino.setPin(PC2_X_MIN_PIN, 0);
+    arduino.setPin(PC2_Y_MIN_PIN, 0);
+    arduino.setPin(PC2_Z_MIN_PIN, 0);
+    Machine machine;
+    machine.enable(true);
+    for (MotorIndex i = 0; i < 3; i++) {
+        machine.axis[i].travelMin = -100;
+        machine.axis[i].travelMax = 100;
+    }
+    int32_t xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    int32_t ypulses = arduino.pulses(PC2_Y_STEP_PIN);
+    int32_t zpulses = arduino.pulses(PC2_Z_STEP_PIN);
+
+    // several blocks beyond travel limits without changing position
+    machine.axis[1].usDelay = 10;
+    int32_t usStart = delayMicsTotal;
+    Quad<StepCoord> pulses(300, -200, 5, 0);
+    ASSERTEQUAL(STATUS_OK, machine.pulse(pulses));
+    ASSERTQUAD(Quad<StepCoord>(), pulses);
+    ASSERTQUAD(Quad<StepCoord>(), machine.getMotorPosition());
+    ASSERTEQUAL(xpulses + 300, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses + 200, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(zpulses + 5, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERTEQUAL(HIGH, arduino.getPin(PC2_X_DIR_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_Y_DIR_PIN));
+    ASSERTEQUAL(HIGH, arduino.getPin(PC2_Z_DIR_PIN));
+    ASSERTEQUAL(usStart + 10 * 200, delayMicsTotal);
+    machine.axis[1].usDelay = 0;
+
+    // limit switch stops the block and leaves position unchanged
+    arduino.setPin(PC2_Y_MIN_PIN, 1);
+    pulses = Quad<StepCoord>(0, -10, 0, 0);
+    ASSERTEQUAL(STATUS_LIMIT_MIN, machine.pulse(pulses));
+    ASSERTQUAD(Quad<StepCoord>(0, -10, 0, 0), pulses);
+    ASSERTQUAD(Quad<StepCoord>(), machine.getMotorPosition());
+    ASSERTEQUAL(ypulses + 200, arduino.pulses(PC2_Y_STEP_PIN));
+
+    cout << "TEST	: test_pulse() OK " << endl;
+}
+
 void test_Move() {
     cout << "TEST	: test_Move() =====" << endl;
 
@@ -1163,13 +2088,45 @@ void test_Move() {
     int32_t zpulses = arduino.pulses(PC2_Z_STEP_PIN);
     int32_t usStart = delayMicsTotal;
 
-    Status status = machine.moveTo(Quad<StepCoord>(1, 10, 100, 0), 1);
-    ASSERTEQUAL(STATUS_OK, status);
+    // trapezoidal profile completes in the planned ticks
+    Quad<StepCoord> dest(1, 10, 100, 0);
+    Ticks dt = MS_TICKS(1000);
+    Ticks t0 = 1000;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0));
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.getMotorPosition());
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + dt / 8));
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 4, 0), machine.getMotorPosition());
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + dt / 2));
+    ASSERTQUAD(Quad<StepCoord>(0, 5, 50, 0), machine.getMotorPosition());
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + (dt * 7) / 8));
+    ASSERTQUAD(Quad<StepCoord>(1, 10, 96, 0), machine.getMotorPosition());
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + dt - 1));
+    ASSERTQUAD(Quad<StepCoord>(1, 10, 100, 0), machine.getMotorPosition());
+    ASSERTEQUAL(STATUS_OK, machine.moveTo(dest, 1, t0 + dt));
     ASSERTEQUAL(xpulses + 1, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUAL(ypulses + 10, arduino.pulses(PC2_Y_STEP_PIN));
     ASSERTEQUAL(zpulses + 100, arduino.pulses(PC2_Z_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(1, 10, 100, 0), machine.getMotorPosition());
-    ASSERTEQUALT(usStart + 1000000, delayMicsTotal, 20000);
+    ASSERTEQUAL(usStart, delayMicsTotal);
+
+    // axis usDelay limits peak velocity
+    machine.axis[2].usDelay = 20000;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(Quad<StepCoord>(), 1, t0));
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(Quad<StepCoord>(), 1, t0 + dt));
+    ASSERTEQUAL(STATUS_OK, machine.moveTo(Quad<StepCoord>(), 1, t0 + (100 * 20000L * 4) / (3 * 64)));
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.getMotorPosition());
+
+    // long slow moves do not overflow the minimum move time
+    dest = Quad<StepCoord>(0, 0, 30000, 0);
+    Ticks dtSlow = (30000 * 20000L / 64) * 4 / 3;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0));
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + dt));
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + dtSlow / 2));
+    ASSERTQUAD(Quad<StepCoord>(0, 0, 15000, 0), machine.getMotorPosition());
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveTo(dest, 1, t0 + dtSlow - 1));
+    ASSERTEQUAL(STATUS_OK, machine.moveTo(dest, 1, t0 + dtSlow));
+    ASSERTQUAD(dest, machine.getMotorPosition());
+    machine.axis[2].usDelay = 0;
 
     usStart = delayMicsTotal;
     xpulses = arduino.pulses(PC2_X_STEP_PIN);
@@ -1188,13 +2145,26 @@ void test_Move() {
 
     threadClock.ticks++;
     mt.loop();
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    Ticks tMove = ticks();
+    arduino.timer1(MS_TICKS(500));
+    threadClock.ticks++;
+    mt.loop();
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    ASSERTEQUALT(50, machine.getMotorPosition().value[2], 2);
+    while (mt.status == STATUS_BUSY_MOVING) {
+        arduino.timer1(MS_TICKS(100));
+        threadClock.ticks++;
+        mt.loop();
+    }
     ASSERTEQUAL(STATUS_OK, mt.status);
+    ASSERTEQUALT(tMove + MS_TICKS(1000), ticks(), MS_TICKS(100));
     ASSERTEQUAL(xpulses + 1, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUAL(ypulses + 10, arduino.pulses(PC2_Y_STEP_PIN));
     ASSERTEQUAL(zpulses + 100, arduino.pulses(PC2_Z_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(1, 10, 100, 0), machine.getMotorPosition());
     ASSERTEQUALS(JT("{'s':0,'r':{'mov':{'1':1,'2':10,'3':100,'sr':1}}}\n"), Serial.output().c_str());
-    ASSERTEQUALT(usStart + 1000000, delayMicsTotal, 20000);
+    ASSERTEQUAL(usStart, delayMicsTotal);
 
     threadClock.ticks++;
     mt.loop();
@@ -1244,7 +2214,7 @@ void test_dvs() {
     test_ticks(1); // initialize
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(xpulses, arduino.pulses(PC2_X_STEP_PIN));
-	ASSERTEQUAL(0, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(0, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(1); // start moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
@@ -1253,71 +2223,78 @@ void test_dvs() {
     test_ticks(MS_TICKS(100)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(1, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(100)+3, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(100)+3, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(100)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(2, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(200)+3, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(200)+3, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(100)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(3, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(300)+4, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(300)+4, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(100)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(4, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(400)+4, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(400)+4, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(500) - 4*MS_TICKS(100)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(5, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(500)+7, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(500)+7, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(1000)-MS_TICKS(500)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(10, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(1000)+8, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(1000)+8, threadClock.ticks - machine.stroke().tStart);
 	ASSERTQUAD(Quad<StepCoord>(110,100,100,100), machine.getMotorPosition());
 
     test_ticks(MS_TICKS(500)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(15, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(1500)+9, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(1500)+9, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(1000)-MS_TICKS(500)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(20, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(2000)+10, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(2000)+10, threadClock.ticks - machine.stroke().tStart);
 	ASSERTQUAD(Quad<StepCoord>(120,100,100,100), machine.getMotorPosition());
 
     test_ticks(MS_TICKS(1000)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(30, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(3000)+11, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(3000)+11, threadClock.ticks - machine.stroke().tStart);
 	ASSERTQUAD(Quad<StepCoord>(130,100,100,100), machine.getMotorPosition());
 
     test_ticks(MS_TICKS(500)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(35, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(3500)+12, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(3500)+12, threadClock.ticks - machine.stroke().tStart);
 
     test_ticks(MS_TICKS(600)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(41, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
-	ASSERTEQUAL(MS_TICKS(4100)+13, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(4100)+13, threadClock.ticks - machine.stroke().tStart);
 	ASSERTQUAD(Quad<StepCoord>(141,100,100,100), machine.getMotorPosition());
 
     test_ticks(MS_TICKS(600)); // moving
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(MS_TICKS(4700)+14, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(4700)+14, threadClock.ticks - machine.stroke().tStart);
 	ASSERTQUAD(Quad<StepCoord>(147,100,100,100), machine.getMotorPosition());
     ASSERTEQUAL(47, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
 
     test_ticks(MS_TICKS(1000)); // done
+#ifdef STEP_ENGINE
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status); // last pulses were queued
+    test_ticks(1);
     ASSERTEQUAL(STATUS_OK, mt.status);
-	ASSERTEQUAL(MS_TICKS(5700)+15, threadClock.ticks - machine.stroke.tStart);
+	ASSERTEQUAL(MS_TICKS(5700)+17, threadClock.ticks - machine.stroke().tStart);
+#else
+    ASSERTEQUAL(STATUS_OK, mt.status);
+	ASSERTEQUAL(MS_TICKS(5700)+15, threadClock.ticks - machine.stroke().tStart);
+#endif
 	ASSERTEQUALS(JT("{'s':0,'r':{'dvs':{'us':5000000,'x':50}}}\n"), Serial.output().c_str());
     ASSERTEQUAL(50, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
 	ASSERTQUAD(Quad<StepCoord>(150,100,100,100), machine.getMotorPosition());
@@ -1325,6 +2302,157 @@ void test_dvs() {
     cout << "TEST	: test_dvs() OK " << endl;
 }
 
+void test_dvs_stream() {
+    cout << "TEST	: test_dvs_stream() =====" << endl;
+
+#if STROKE_BUFFERS > 1
+    MachineThread mt = test_setup();
+    Machine &machine = mt.machine;
+	machine.setMotorPosition(Quad<StepCoord>(100,100,100,100));
+
+    Serial.push(JT("{'dvs':{'us':1000000,'x':[10,0,0,0,0]}}\n"));
+    test_ticks(1); // parse
+    test_ticks(1); // initialize
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    ASSERTEQUAL(1, machine.getStrokeCount());
+	Stroke *pStroke1 = &machine.stroke();
+	Ticks tEnd1 = pStroke1->tStart + pStroke1->get_dtTotal();
+
+	// second stroke is queued while the first traverses
+    Serial.push(JT("{'dvs':{'us':1000000,'x':[-10,0,0,0,0]}}\n"));
+    test_ticks(1);
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.statusNext);
+    ASSERTEQUAL(2, machine.getStrokeCount());
+	ASSERTEQUAL((size_t) pStroke1, (size_t) &machine.stroke());
+	ASSERTEQUALS("", Serial.output().c_str());
+
+	// first stroke ends and second stroke starts on the same tick
+	for (int i=0; i<2*TICKS_PER_SECOND && machine.getStrokeCount() == 2; i++) {
+		test_ticks(1);
+	}
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    ASSERTEQUAL(1, machine.getStrokeCount());
+	ASSERT(pStroke1 != &machine.stroke());
+	ASSERTEQUAL(tEnd1, machine.stroke().tStart);
+	ASSERTQUAD(Quad<StepCoord>(150,100,100,100), machine.getMotorPosition());
+	ASSERTEQUALS(JT("{'s':0,'r':{'dvs':{'us':1000000,'x':50}}}\n"), Serial.output().c_str());
+
+	Serial.clear();
+	for (int i=0; i<2*TICKS_PER_SECOND && mt.status == STATUS_BUSY_MOVING; i++) {
+		test_ticks(1);
+	}
+    ASSERTEQUAL(STATUS_OK, mt.status);
+    ASSERTEQUAL(0, machine.getStrokeCount());
+	ASSERTQUAD(Quad<StepCoord>(100,100,100,100), machine.getMotorPosition());
+	ASSERTEQUALS(JT("{'s':0,'r':{'dvs':{'us':1000000,'x':-50}}}\n"), Serial.output().c_str());
+
+    test_ticks(1); // idle
+#endif
+
+    cout << "TEST	: test_dvs_stream() OK " << endl;
+}
+
+void test_dvs_feedrate() {
+    cout << "TEST	: test_dvs_feedrate() =====" << endl;
+
+    MachineThread mt = test_setup();
+    Machine &machine = mt.machine;
+	machine.setMotorPosition(Quad<StepCoord>(100,100,100,100));
+
+	// feed rate override is applied while the stroke response is parked
+    Serial.push(JT("{'dvs':{'us':1000000,'x':[10,0,0,0,0]}}\n"));
+    test_ticks(1); // parse
+    test_ticks(1); // initialize
+    for (int i=0; i<TICKS_PER_SECOND/4; i++) {
+        test_ticks(1);
+    }
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    Ticks dt100 = machine.stroke().get_dtTotal();
+    Quad<StepCoord> pos100 = machine.stroke().goalPos(ticks());
+    ASSERT(machine.getMotorPosition().value[0] > 100);
+    Serial.clear();
+    Serial.push(JT("{'sysfo':50}\n"));
+    test_ticks(1);
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    ASSERTEQUAL(STATUS_WAIT_IDLE, mt.statusNext);
+	ASSERTEQUALS(JT("{'s':0,'r':{'sysfo':50}}\n"), Serial.output().c_str());
+    ASSERTEQUAL(1, machine.getStrokeCount());
+    ASSERTEQUAL(2 * dt100, machine.stroke().get_dtTotal());
+    Quad<StepCoord> pos50 = machine.stroke().goalPos(ticks());
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        ASSERT(abs(pos50.value[i] - pos100.value[i]) <= 1);
+    }
+    Ticks tEnd50 = machine.stroke().tStart + machine.stroke().get_dtTotal();
+    ASSERT(tEnd50 - ticks() > dt100); // 3/4 of the stroke remains at half speed
+
+	// stroke continues at half speed
+    Serial.clear();
+	for (int i=0; i<4*TICKS_PER_SECOND && mt.status == STATUS_BUSY_MOVING; i++) {
+		test_ticks(1);
+	}
+    ASSERTEQUAL(STATUS_OK, mt.status);
+    ASSERT(ticks() >= tEnd50);
+	ASSERTQUAD(Quad<StepCoord>(150,100,100,100), machine.getMotorPosition());
+	ASSERTEQUALS(JT("{'s':0,'r':{'dvs':{'us':1000000,'x':50}}}\n"), Serial.output().c_str());
+
+	// other input cancels the parked stroke and becomes the current command
+    test_ticks(1); // idle
+    Serial.push(JT("{'dvs':{'us':1000000,'x':[10,0,0,0,0]}}\n"));
+    test_ticks(1); // parse
+    test_ticks(1); // initialize
+    Serial.push(JT("{'sysfo':100}\n"));
+    test_ticks(1);
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    Serial.clear();
+    Serial.push(JT("{'1ma':''}\n"));
+    test_ticks(1);
+    ASSERTEQUAL(STATUS_BUSY_PARSED, mt.status);
+    ASSERTEQUAL(0, machine.getStrokeCount());
+	ASSERTEQUALS(JT("{'s':-901,'r':{'dvs':{'us':1000000,'x':50}}}\n"), Serial.output().c_str());
+    test_ticks(1);
+    ASSERTEQUAL(STATUS_OK, mt.status);
+	ASSERTEQUALS(JT("{'s':0,'r':{'1ma':0}}\n"), Serial.output().c_str());
+
+#ifdef STROKE_GENERATOR
+	// feed rate override is applied to a generated line
+    test_ticks(1); // idle
+	machine.setMotorPosition(Quad<StepCoord>(100,100,100,100));
+    Serial.push(JT("{'lin':{'x':400,'mv':800,'od':true}}\n"));
+    test_ticks(1); // parse
+    test_ticks(1); // initialize
+    StrokeGenerator &sg = machine.lineGenerator;
+    while (ticks() - sg.tStart < sg.dtTotal / 4) {
+        test_ticks(1);
+    }
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    dt100 = sg.dtTotal;
+    pos100 = sg.goalPos(ticks());
+    Serial.clear();
+    Serial.push(JT("{'sysfo':50}\n"));
+    test_ticks(1);
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+	ASSERTEQUALS(JT("{'s':0,'r':{'sysfo':50}}\n"), Serial.output().c_str());
+    ASSERTEQUAL(2 * dt100, sg.dtTotal);
+    pos50 = sg.goalPos(ticks());
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        ASSERT(abs(pos50.value[i] - pos100.value[i]) <= 1);
+    }
+    tEnd50 = sg.tStart + sg.dtTotal;
+    ASSERT(tEnd50 - ticks() > dt100);
+    Serial.clear();
+	for (int i=0; i<8*TICKS_PER_SECOND && mt.status == STATUS_BUSY_MOVING; i++) {
+		test_ticks(1);
+	}
+    ASSERTEQUAL(STATUS_OK, mt.status);
+    ASSERT(ticks() >= tEnd50);
+	ASSERTQUAD(Quad<StepCoord>(500,100,100,100), machine.getMotorPosition());
+	ASSERTEQUALS(JT("{'s':0,'r':{'lin':{'x':400,'mv':800,'od':true}}}\n"), Serial.output().c_str());
+#endif
+
+    cout << "TEST	: test_dvs_feedrate() OK " << endl;
+}
+
 void test_error(MachineThread &mt, const char * cmd, Status status, const char *output=NULL) {
     Serial.push(JT(cmd));
     test_ticks(1); // parse
@@ -1395,6 +2523,120 @@ void test_PrettyPrint() {
     cout << "TEST	: test_PrettyPrint() OK " << endl;
 }
 
+void test_homeParallel() {
+    cout << "TEST	: test_homeParallel() =====" << endl;
+
+    arduino.clear();
+    arduino.setPin(PC2_X_MIN_PIN, LOW);
+    arduino.setPin(PC2_Y_MIN_PIN, LOW);
+    arduino.setPin(PC2_Z_MIN_PIN, LOW);
+    Machine machine;
+    machine.enable(true);
+    machine.axis[0].home = 5;
+    machine.axis[1].home = 10;
+    machine.axis[0].searchDelay = 80;	// seek 40us latch 80us
+    machine.axis[1].searchDelay = 160;	// seek 80us latch 160us
+    machine.axis[0].homing = true;
+    machine.axis[1].homing = true;
+    machine.setMotorPosition(Quad<StepCoord>(100, 100, 100, 100));
+    int32_t xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    int32_t ypulses = arduino.pulses(PC2_Y_STEP_PIN);
+    int32_t zpulses = arduino.pulses(PC2_Z_STEP_PIN);
+    Ticks t = 1000;
+
+    // start homing
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTQUAD(Quad<StepCoord>(5, 10, 100, 100), machine.getMotorPosition());
+    ASSERTEQUAL(xpulses, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(HOME_SEEK, machine.axis[0].homePhase);
+    ASSERTEQUAL(HOME_SEEK, machine.axis[1].homePhase);
+
+    // each axis seeks at its own rate
+    t += 10; // 640us
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(xpulses += 16, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses += 8, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(zpulses, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));
+
+    // x switch trips and x backs off slowly
+    arduino.setPin(PC2_X_MIN_PIN, HIGH);
+    t += 10;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(HOME_BACKOFF, machine.axis[0].homePhase);
+    ASSERTEQUAL(xpulses, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses += 8, arduino.pulses(PC2_Y_STEP_PIN));
+    t += 10;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(xpulses += 8, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(HIGH, arduino.getPin(PC2_X_DIR_PIN));
+    arduino.setPin(PC2_X_MIN_PIN, LOW);
+    t += 10;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(xpulses += 8, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(HOME_LATCH, machine.axis[0].homePhase);
+
+    // x latches slowly and backs off to home
+    t += 10;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(xpulses += 8, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));
+    arduino.setPin(PC2_X_MIN_PIN, HIGH);
+    t += 10;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(HOME_RELEASE, machine.axis[0].homePhase);
+    t += 20;
+    ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t));
+    ASSERTEQUAL(xpulses += MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(HIGH, arduino.getPin(PC2_X_DIR_PIN));
+    ASSERTEQUAL(false, machine.axis[0].homing);
+    ASSERTEQUAL(HOME_IDLE, machine.axis[0].homePhase);
+    ASSERTEQUAL(true, machine.axis[1].homing);
+    ASSERTEQUAL(HOME_SEEK, machine.axis[1].homePhase);
+
+    // y finishes with long gaps between invocations
+    arduino.setPin(PC2_Y_MIN_PIN, HIGH);
+    int32_t ystart = arduino.pulses(PC2_Y_STEP_PIN);
+    Status status = STATUS_BUSY_MOVING;
+    for (int i = 0; i < 10 && status == STATUS_BUSY_MOVING; i++) {
+        t += 1000;
+        status = machine.home(t);
+        if (machine.axis[1].homePhase == HOME_LATCH) {
+            arduino.setPin(PC2_Y_MIN_PIN, LOW);
+            t += 1000;
+            ASSERTEQUAL(STATUS_BUSY_MOVING, machine.home(t)); // HOME_PULSES per invocation
+            ASSERTEQUAL(HOME_LATCH, machine.axis[1].homePhase);
+            arduino.setPin(PC2_Y_MIN_PIN, HIGH);
+        }
+    }
+    ASSERTEQUAL(STATUS_OK, status);
+    ASSERTEQUAL(ystart + 2 * MICROSTEPS_DEFAULT + HOME_PULSES, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(xpulses, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTQUAD(Quad<StepCoord>(5, 10, 100, 100), machine.getMotorPosition());
+
+    // disabled axis with a limit switch
+    machine.axis[0].enable(false);
+    machine.axis[0].homing = true;
+    ASSERTEQUAL(STATUS_AXIS_DISABLED, machine.home(t));
+    machine.clearHome();
+    ASSERTEQUAL(false, machine.axis[0].homing);
+    ASSERTEQUAL(STATUS_OK, machine.home(t));
+
+    cout << "TEST	: test_homeParallel() OK " << endl;
+}
+
+/**
+ * Run the machine thread until the given axis stops homing
+ */
+void test_homeAxis(MachineThread &mt, Axis &axis) {
+    for (int i = 0; i < 100 && axis.homing; i++) {
+        arduino.timer1(10);
+        threadClock.ticks++;
+        mt.loop();
+    }
+    ASSERTEQUAL(false, axis.homing);
+}
+
 void test_Home() {
     cout << "TEST	: test_Home() =====" << endl;
 
@@ -1430,45 +2672,33 @@ void test_Home() {
     ASSERTEQUALS("", Serial.output().c_str());
 
     threadClock.ticks++;
-    mt.loop(); // moving
+    mt.loop(); // start homing
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUALS("", Serial.output().c_str());
-    ASSERT(machine.motorAxis[0]->homing);
-    ASSERT(!machine.motorAxis[1]->homing);
-    ASSERT(machine.motorAxis[2]->homing);
-    ASSERT(!machine.motorAxis[3]->homing);
-    ASSERTEQUAL(xpulses + 32*1, arduino.pulses(PC2_X_STEP_PIN));
-    ASSERTEQUAL(ypulses, arduino.pulses(PC2_Y_STEP_PIN));
-    ASSERTEQUAL(zpulses + 32*1, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERTEQUAL(HOME_SEEK, machine.motorAxis[0]->homePhase);
+    ASSERTEQUAL(HOME_IDLE, machine.motorAxis[1]->homePhase);
+    ASSERTEQUAL(HOME_SEEK, machine.motorAxis[2]->homePhase);
     ASSERTQUAD(Quad<StepCoord>(5, 100, 20, 100), mt.machine.getMotorPosition());
-    ASSERTEQUALS("", Serial.output().c_str());
 
+    arduino.timer1(10);
     threadClock.ticks++;
-    mt.loop();
+    mt.loop(); // seek
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-    ASSERT(machine.motorAxis[0]->homing);
-    ASSERT(!machine.motorAxis[1]->homing);
-    ASSERT(machine.motorAxis[2]->homing);
-    ASSERT(!machine.motorAxis[3]->homing);
-    ASSERTEQUAL(xpulses + 32*2, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERT(xpulses < arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUAL(ypulses, arduino.pulses(PC2_Y_STEP_PIN));
-    ASSERTEQUAL(zpulses + 32*2, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERT(zpulses < arduino.pulses(PC2_Z_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(5, 100, 20, 100), mt.machine.getMotorPosition());
-    ASSERTEQUAL(true, machine.axis[0].homing);
-    ASSERTEQUAL(false, machine.axis[1].homing);
-    ASSERTEQUAL(true, machine.axis[2].homing);
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));
     ASSERTEQUAL(LOW, arduino.getPin(PC2_Y_DIR_PIN));
     ASSERTEQUAL(LOW, arduino.getPin(PC2_Z_DIR_PIN));
     ASSERTEQUALS("", Serial.output().c_str());
 
     arduino.setPin(PC2_X_MIN_PIN, HIGH);
-    threadClock.ticks++;
-    mt.loop(); // hit first limit switch
+    xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    test_homeAxis(mt, machine.axis[0]); // back off, latch and back off
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-    ASSERTEQUAL(xpulses + 32*2 + MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(xpulses + 2 * MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUAL(ypulses, arduino.pulses(PC2_Y_STEP_PIN));
-    ASSERTEQUAL(zpulses + 32*3, arduino.pulses(PC2_Z_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(5, 100, 20, 100), mt.machine.getMotorPosition());
     ASSERTEQUAL(false, machine.axis[0].homing);
     ASSERTEQUAL(false, machine.axis[1].homing);
@@ -1479,12 +2709,11 @@ void test_Home() {
     ASSERTEQUALS("", Serial.output().c_str());
 
     arduino.setPin(PC2_Z_MIN_PIN, HIGH);
-    threadClock.ticks++;
-    mt.loop(); // hit final limit switch
+    zpulses = arduino.pulses(PC2_Z_STEP_PIN);
+    test_homeAxis(mt, machine.axis[2]);
     ASSERTEQUAL(STATUS_OK, mt.status);
-    ASSERTEQUAL(xpulses + 32*2 + MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUAL(ypulses, arduino.pulses(PC2_Y_STEP_PIN));
-    ASSERTEQUAL(zpulses + 32*3 + MICROSTEPS_DEFAULT, arduino.pulses(PC2_Z_STEP_PIN));
+    ASSERTEQUAL(zpulses + 2 * MICROSTEPS_DEFAULT, arduino.pulses(PC2_Z_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(5, 100, 20, 100), mt.machine.getMotorPosition());
     ASSERTEQUAL(false, machine.axis[0].homing);
     ASSERTEQUAL(false, machine.axis[1].homing);
@@ -1495,7 +2724,6 @@ void test_Home() {
     ASSERTEQUALS(JT("{'s':0,'r':{'ho':{'x':5,'z':20}}}\n"), Serial.output().c_str());
 
 	// TEST ONE-AXIS SHORT FORM
-    xpulses = arduino.pulses(PC2_X_STEP_PIN);
     machine.setMotorPosition(Quad<StepCoord>(100, 100, 100, 100));
     arduino.setPin(PC2_X_MIN_PIN, LOW);
     threadClock.ticks++;
@@ -1507,27 +2735,28 @@ void test_Home() {
     mt.loop();	// parse
     ASSERTEQUAL(STATUS_BUSY_PARSED, mt.status);
 
+    xpulses = arduino.pulses(PC2_X_STEP_PIN);
     threadClock.ticks++;
     mt.loop(); // initializing
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(xpulses, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUALS("", Serial.output().c_str());
 
+    arduino.timer1(10);
     threadClock.ticks++;
-    mt.loop(); // moving
-    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    mt.loop(); // seek
     ASSERTEQUALS("", Serial.output().c_str());
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
 
     arduino.setPin(PC2_X_MIN_PIN, HIGH);
-    threadClock.ticks++;
-    mt.loop(); // hit limit switch
+    xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    test_homeAxis(mt, machine.axis[0]);
     ASSERTEQUAL(STATUS_OK, mt.status);
-    ASSERTEQUAL(xpulses + 32*1 + MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(xpulses + 2 * MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(5, 100, 100, 100), mt.machine.getMotorPosition());
     ASSERTEQUALS(JT("{'s':0,'r':{'hox':5}}\n"), Serial.output().c_str());
 
 	// TEST SHORT FORM
-    xpulses = arduino.pulses(PC2_X_STEP_PIN);
 	machine.axis[1].enabled = false;
 	machine.axis[2].enabled = false;
     machine.setMotorPosition(Quad<StepCoord>(100, 100, 100, 100));
@@ -1541,22 +2770,24 @@ void test_Home() {
     mt.loop();	// parse
     ASSERTEQUAL(STATUS_BUSY_PARSED, mt.status);
 
+    xpulses = arduino.pulses(PC2_X_STEP_PIN);
     threadClock.ticks++;
     mt.loop(); // initializing
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
     ASSERTEQUAL(xpulses, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTEQUALS("", Serial.output().c_str());
 
+    arduino.timer1(10);
     threadClock.ticks++;
-    mt.loop(); // moving
+    mt.loop(); // seek
     ASSERTEQUALS("", Serial.output().c_str());
     ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
 
     arduino.setPin(PC2_X_MIN_PIN, HIGH);
-    threadClock.ticks++;
-    mt.loop(); // hit limit switch
+    xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    test_homeAxis(mt, machine.axis[0]);
     ASSERTEQUAL(STATUS_OK, mt.status);
-    ASSERTEQUAL(xpulses + 32*1 + MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(xpulses + 2 * MICROSTEPS_DEFAULT, arduino.pulses(PC2_X_STEP_PIN));
     ASSERTQUAD(Quad<StepCoord>(5, 100, 100, 100), mt.machine.getMotorPosition());
     ASSERTEQUALS(JT("{'s':0,'r':{'ho':{'1':5,'2':100,'3':100,'4':100}}}\n"), Serial.output().c_str());
 
@@ -1604,9 +2835,19 @@ void test_MachineThread() {
 
     Serial.clear();
 	arduino.timer1(1); ticks(); mt.loop();
+#ifdef STEP_ENGINE
+    ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
+    ASSERTEQUALS("", Serial.output().c_str());
+    test_drain();
+	arduino.timer1(1); ticks(); mt.loop();
+    ASSERTEQUAL(STATUS_OK, mt.status);
+    jsonOut =
+        "{'s':0,'r':{'systc':117,'dvs':{'us':123,'dp':[10,20],'1':10,'2':20,'3':0}}}\n";
+#else
     ASSERTEQUAL(STATUS_OK, mt.status);
     jsonOut =
         "{'s':0,'r':{'systc':114,'dvs':{'us':123,'dp':[10,20],'1':10,'2':20,'3':0}}}\n";
+#endif
     ASSERTEQUALS(JT(jsonOut), Serial.output().c_str());
     ASSERTQUAD(Quad<StepCoord>(10, 20, 0, 0), mt.machine.getMotorPosition());
 
@@ -1687,30 +2928,32 @@ void test_ph5() {
 	arduino.timer1(1);
 	StrokeBuilder sb;
 	ASSERTQUAD(Quad<StepCoord>(), machine.getMotorPosition());
-	Status status = sb.buildLine(machine.stroke, Quad<StepCoord>(6400,3200,1600,0));
+	Status status = sb.buildLine(machine.stroke(), Quad<StepCoord>(6400,3200,1600,0));
 	ASSERTEQUAL(STATUS_OK, status);
-	ASSERTEQUAL(25, machine.stroke.length);
-	ASSERTEQUAL(1, machine.stroke.seg[0].value[0]);
-	ASSERTEQUAL(7, machine.stroke.seg[1].value[0]);
-	ASSERTEQUAL(22, machine.stroke.seg[2].value[0]);
-	ASSERTEQUAL(41, machine.stroke.seg[3].value[0]);
-	ASSERTEQUAL(58, machine.stroke.seg[4].value[0]);
-	ASSERTEQUAL(70, machine.stroke.seg[5].value[0]);
-	ASSERTEQUAL(76, machine.stroke.seg[6].value[0]); // peak velocity
-	ASSERTEQUAL(75, machine.stroke.seg[7].value[0]); 
-	ASSERTEQUAL(63, machine.stroke.seg[8].value[0]);
+	ASSERTEQUAL(25, machine.stroke().length);
+	StepDV dvRef[] = {1, 7, 22, 41, 58, 70, 76, 75, 63}; // peak velocity at seg[6]
+#ifdef PH5_FIXED
+	StepDV dvTol = 2; // fixed point positions are within 1 pulse of float
+#else
+	StepDV dvTol = 0;
+#endif
+	for (SegIndex s = 0; s < 9; s++) {
+		if (abs(dvRef[s] - machine.stroke().seg[s].value[0]) > dvTol) {
+			ASSERTEQUAL(dvRef[s], machine.stroke().seg[s].value[0]);
+		}
+	}
 	int32_t xpulses = arduino.pulses(PC2_X_STEP_PIN);
 	StepCoord xpos = machine.axis[0].position;
 
-	machine.stroke.start(ticks());
+	machine.stroke().start(ticks());
 
 	int i = 0;
-	status =  machine.stroke.traverse(ticks(), machine);
+	status =  machine.stroke().traverse(ticks(), machine);
 	ASSERTEQUAL(STATUS_BUSY_MOVING, status);
-	status =  machine.stroke.traverse(ticks(), machine);
+	status =  machine.stroke().traverse(ticks(), machine);
 	ASSERTEQUAL(STATUS_BUSY_MOVING, status);
 	do {
-		status =  machine.stroke.traverse(ticks(), machine);
+		status =  machine.stroke().traverse(ticks(), machine);
 		StepCoord xposnew = machine.axis[0].position;
 		ASSERT(xposnew >= xpos);
 		xpos = xposnew;
@@ -1721,20 +2964,40 @@ void test_ph5() {
 	ASSERTEQUAL(STATUS_OK, status);
 	ASSERTQUAD(Quad<StepCoord>(6400, 3200, 1600, 0), machine.getMotorPosition());
 
+	// TEST: lazy line generates segments during traversal
+	StrokeGenerator sg(sb, Quad<StepCoord>(-6400, -3200, -1600, 0));
+	ASSERTEQUAL(machine.stroke().length, sg.length);
+	ASSERTEQUAL(machine.stroke().get_dtTotal(), sg.dtTotal);
+	ASSERTEQUAL(0, sg.getGenerated());
+	ASSERTEQUAL(STATUS_OK, sg.start(ticks()));
+	ASSERTEQUAL(1, sg.getGenerated());
+	do {
+		status = sg.traverse(ticks(), machine);
+		ASSERT(sg.getGenerated() <= sg.curSeg + GENERATOR_WINDOW - 1);
+		ASSERT(sg.curSeg < sg.getGenerated());
+		StepCoord xposnew = machine.axis[0].position;
+		ASSERT(xposnew <= xpos);
+		xpos = xposnew;
+	} while (status == STATUS_BUSY_MOVING);
+	ASSERTEQUAL(STATUS_OK, status);
+	ASSERTEQUAL(sg.length, sg.getGenerated());
+	ASSERTQUAD(Quad<StepCoord>(0, 0, 0, 0), machine.getMotorPosition());
+	ASSERT(abs(machine.stroke().vPeak - sg.vPeak) <= 1);
+
 	// TEST: short line
 	xpulses = arduino.pulses(PC2_X_STEP_PIN);
 	int32_t xdirpulses = arduino.pulses(PC2_X_DIR_PIN);
     ASSERTEQUAL(0, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
     Serial.push(JT("{'tstph':{'pu':3200,'tv':'','sg':'','mv':'','lp':''}}\n")); 
     mt.loop();	// command.parse
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUAL(STATUS_BUSY_PARSED, mt.status);
     ASSERTEQUAL(0, Serial.available()); // expected parse
     ASSERTEQUAL(0, arduino.pulses(PC2_X_STEP_PIN)-xpulses);
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// reversing once
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// reversing
@@ -1743,7 +3006,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process (second stroke)
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(2, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1770,7 +3033,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// never reversing
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1797,7 +3060,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// never reversing
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1824,7 +3087,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// never reversing
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1851,7 +3114,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// never reversing
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1878,7 +3141,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// never reversing
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1905,7 +3168,7 @@ void test_ph5() {
 
 	mt.loop();	// command.process
 	ASSERTEQUAL(STATUS_BUSY_MOVING, mt.status);
-	ASSERTEQUAL(true, machine.stroke.isDone());
+	ASSERTEQUAL(true, machine.stroke().isDone());
     ASSERTEQUALS(JT(""), Serial.output().c_str());
     ASSERTEQUAL(1, arduino.pulses(PC2_X_DIR_PIN)-xdirpulses);	// never reversing
     ASSERTEQUAL(LOW, arduino.getPin(PC2_X_DIR_PIN));	// advancing
@@ -1926,6 +3189,234 @@ void test_ph5() {
     cout << "TEST	: test_ph5() OK " << endl;
 }
 
+/**
+ * Reference buildLine() that builds a PH5 curve and feed for every axis
+ */
+Status buildLinePerAxis(StrokeBuilder &sb, Stroke & stroke, Quad<StepCoord> relPos) {
+    PH5TYPE K[QUAD_ELEMENTS];
+    PHVECTOR<Complex<PH5TYPE> > z[QUAD_ELEMENTS];
+    PHVECTOR<Complex<PH5TYPE> > q[QUAD_ELEMENTS];
+	StepCoord pulses = 0;
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        K[i] = relPos.value[i] / 6400.0;
+		PH5TYPE zK = 56.568542495 * sqrt(abs(K[i]));
+		pulses = max((StepCoord) abs(relPos.value[i]), pulses);
+		z[i].push_back(Complex<PH5TYPE>());
+		z[i].push_back(K[i] < 0 ? Complex<PH5TYPE>(0, zK) : Complex<PH5TYPE>(zK));
+		z[i].push_back(K[i] < 0 ? Complex<PH5TYPE>(0, zK) : Complex<PH5TYPE>(zK));
+        q[i].push_back(Complex<PH5TYPE>());
+        q[i].push_back(Complex<PH5TYPE>(3200 * K[i]));
+        q[i].push_back(Complex<PH5TYPE>(6400 * K[i]));
+    }
+    PH5Curve<PH5TYPE> ph[] = {
+        PH5Curve<PH5TYPE>(z[0], q[0]),
+        PH5Curve<PH5TYPE>(z[1], q[1]),
+        PH5Curve<PH5TYPE>(z[2], q[2]),
+        PH5Curve<PH5TYPE>(z[3], q[3])
+    };
+    PHFeed<PH5TYPE> phf[] = {
+        PHFeed<PH5TYPE>(ph[0], sb.vMax, sb.vMaxSeconds),
+        PHFeed<PH5TYPE>(ph[1], sb.vMax, sb.vMaxSeconds),
+        PHFeed<PH5TYPE>(ph[2], sb.vMax, sb.vMaxSeconds),
+        PHFeed<PH5TYPE>(ph[3], sb.vMax, sb.vMaxSeconds)
+    };
+    PH5TYPE tS = 0;
+    QuadIndex iMax = 0;
+    for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        if (K[i] != 0 && phf[i].get_tS() > tS) {
+			iMax = i;
+			tS = phf[i].get_tS();
+        }
+    }
+    stroke.clear();
+    int16_t N = sb.segmentCount(tS, pulses, SEGMENT_COUNT-1);
+    Quad<StepCoord> s;
+    Quad<StepCoord> v;
+	PH5TYPE E = phf[iMax].Ekt(0, 0);
+    for (int16_t iSeg = 1; iSeg <= N; iSeg++) {
+        E = phf[iMax].Ekt(E, iSeg / (PH5TYPE)N);
+		Quad<StepDV> segment;
+        for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+			PH5TYPE pos = ph[i].r(E).Re();
+			StepCoord sNew = pos < 0 ? pos-0.5 : pos+0.5;
+			segment.value[i] = (sNew - s.value[i]) - v.value[i];
+			v.value[i] = sNew - s.value[i];
+			s.value[i] = sNew;
+        }
+		stroke.append(segment);
+    }
+    stroke.setTimePlanned(tS);
+    return STATUS_OK;
+}
+
+int32_t test_micros() {
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+void test_buildLine_benchmark() {
+    cout << "TEST	: test_buildLine_benchmark() =====" << endl;
+
+	const int N = 100;
+	StrokeBuilder sb(12800, 0.7, 0, 0);
+	Quad<StepCoord> relPos(6400, -3200, 1600, 0);
+	Stroke stroke;
+	Stroke strokeRef;
+
+	int32_t usStart = test_micros();
+	for (int i = 0; i < N; i++) {
+		ASSERTEQUAL(STATUS_OK, buildLinePerAxis(sb, strokeRef, relPos));
+	}
+	int32_t usRef = test_micros() - usStart;
+	usStart = test_micros();
+	for (int i = 0; i < N; i++) {
+		ASSERTEQUAL(STATUS_OK, sb.buildLine(stroke, relPos));
+	}
+	int32_t usLine = test_micros() - usStart;
+
+	ASSERTEQUAL(strokeRef.length, stroke.length);
+	ASSERTEQUAL(strokeRef.get_dtTotal(), stroke.get_dtTotal());
+	ASSERTEQUAL(STATUS_OK, strokeRef.start(1));
+	ASSERTEQUAL(STATUS_OK, stroke.start(1));
+	for (SegIndex s = 0; s < stroke.length; s++) {
+		Ticks t = 1 + ((s + 1) * stroke.get_dtTotal()) / stroke.length;
+		Quad<StepCoord> dPos = stroke.goalPos(t) - strokeRef.goalPos(t);
+		for (QuadIndex i = 0; i < QUAD_ELEMENTS; i++) {
+			ASSERT(abs(dPos.value[i]) <= 1);
+		}
+	}
+	ASSERTQUAD(relPos, stroke.dEndPos);
+
+	cout << "TEST	: buildLine() per axis:" << usRef / N << "us"
+		<< " dominant axis:" << usLine / N << "us"
+		<< " segments:" << (int) stroke.length << endl;
+    cout << "TEST	: test_buildLine_benchmark() OK " << endl;
+}
+
+/**
+ * Reference moveDelta() that scans every axis for every step
+ */
+Status moveDeltaScan(Machine &machine, Quad<StepCoord> delta) {
+    StepCoord maxDelta = 0;
+    for (MotorIndex i = 0; i < QUAD_ELEMENTS; i++) {
+        maxDelta = max(maxDelta, (StepCoord) abs(delta.value[i]));
+    }
+    for (StepCoord iStep = 1; iStep <= maxDelta; iStep++) {
+        for (MotorIndex i = 0; i < QUAD_ELEMENTS; i++) {
+            StepCoord step = delta.value[i];
+            Axis &a = machine.getMotorAxis(i);
+            if (step == 0) {
+                // do nothing
+            } else if (-step >= iStep) {
+                a.readAtMin(machine.invertLim);
+                if (a.atMin) {
+                    return STATUS_LIMIT_MIN;
+                }
+                if (a.position <= a.travelMin) {
+                    return STATUS_TRAVEL_MIN;
+                }
+                a.pulse(false);
+                a.position--;
+            } else if (step >= iStep) {
+                if (a.position >= a.travelMax) {
+                    return STATUS_TRAVEL_MAX;
+                }
+                a.pulse(true);
+                a.position++;
+            }
+        }
+    }
+    return STATUS_BUSY_MOVING;
+}
+
+void test_moveDelta_benchmark() {
+    cout << "TEST	: test_moveDelta_benchmark() =====" << endl;
+
+    const int N = 20;
+    arduino.clear();
+    arduino.setPin(PC2_X_MIN_PIN, 0);
+    arduino.setPin(PC2_Y_MIN_PIN, 0);
+    arduino.setPin(PC2_Z_MIN_PIN, 0);
+    Machine machine;
+    machine.enable(true);
+    for (MotorIndex i = 0; i < 3; i++) {
+        machine.axis[i].travelMin = -32000;
+        machine.axis[i].travelMax = 32000;
+    }
+    Quad<StepCoord> delta(3200, -1600, 400, 0);
+    Quad<StepCoord> back(-3200, 1600, -400, 0);
+    int32_t xpulses = arduino.pulses(PC2_X_STEP_PIN);
+    int32_t ypulses = arduino.pulses(PC2_Y_STEP_PIN);
+    int32_t zpulses = arduino.pulses(PC2_Z_STEP_PIN);
+
+    int32_t usStart = test_micros();
+    for (int i = 0; i < N; i++) {
+        ASSERTEQUAL(STATUS_BUSY_MOVING, moveDeltaScan(machine, delta));
+        ASSERTEQUAL(STATUS_BUSY_MOVING, moveDeltaScan(machine, back));
+    }
+    int32_t usScan = test_micros() - usStart;
+    usStart = test_micros();
+    for (int i = 0; i < N; i++) {
+        ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveDelta(delta, 0));
+        ASSERTEQUAL(STATUS_BUSY_MOVING, machine.moveDelta(back, 0));
+    }
+    int32_t usDDA = test_micros() - usStart;
+
+    ASSERTQUAD(Quad<StepCoord>(), machine.getMotorPosition());
+    ASSERTEQUAL(xpulses + 4 * N * 3200, arduino.pulses(PC2_X_STEP_PIN));
+    ASSERTEQUAL(ypulses + 4 * N * 1600, arduino.pulses(PC2_Y_STEP_PIN));
+    ASSERTEQUAL(zpulses + 4 * N * 400, arduino.pulses(PC2_Z_STEP_PIN));
+
+    cout << "TEST	: moveDelta() axis scan:" << usScan / (2 * N) << "us"
+         << " DDA:" << usDDA / (2 * N) << "us" << endl;
+    cout << "TEST	: test_moveDelta_benchmark() OK " << endl;
+}
+
+void test_PH5FixedLine() {
+    cout << "TEST	: test_PH5FixedLine() =====" << endl;
+
+	StepCoord pulsesList[] = {1, 100, 3200, 6400, 32000};
+	int32_t usFloat = 0;
+	int32_t usFixed = 0;
+	for (int iPulses = 0; iPulses < 5; iPulses++) {
+		StepCoord pulses = pulsesList[iPulses];
+		PH5TYPE zK = 56.568542495 * sqrt(pulses / 6400.0);
+		PHVECTOR<Complex<PH5TYPE> > z;
+		PHVECTOR<Complex<PH5TYPE> > q;
+		z.push_back(Complex<PH5TYPE>());
+		z.push_back(Complex<PH5TYPE>(zK));
+		z.push_back(Complex<PH5TYPE>(zK));
+		q.push_back(Complex<PH5TYPE>());
+		q.push_back(Complex<PH5TYPE>(pulses / 2.0));
+		q.push_back(Complex<PH5TYPE>(pulses));
+		PH5Curve<PH5TYPE> ph(z, q);
+		PH5FixedLine fixedLine(ph, pulses);
+		ASSERTEQUAL(0, PH5FixedLine::travel(fixedLine.fraction(0), pulses));
+		ASSERTEQUAL(pulses, PH5FixedLine::travel(fixedLine.fraction(1), pulses));
+		StepCoord travel[] = {pulses, (StepCoord) -pulses, (StepCoord) (pulses/3), (StepCoord) (-pulses/7)};
+		for (int iE = 0; iE <= 256; iE++) {
+			PH5TYPE E = iE / 256.0;
+			int32_t usStart = test_micros();
+			PH5TYPE f = ph.r(E).Re() / pulses;
+			usFloat += test_micros() - usStart;
+			usStart = test_micros();
+			PH5Fixed fFixed = fixedLine.fraction(E);
+			usFixed += test_micros() - usStart;
+			for (int i = 0; i < 4; i++) {
+				PH5TYPE pos = f * travel[i];
+				StepCoord posFloat = pos < 0 ? pos - 0.5 : pos + 0.5;
+				StepCoord posFixed = PH5FixedLine::travel(fFixed, travel[i]);
+				ASSERT(abs(posFloat - posFixed) <= 1);
+			}
+		}
+	}
+	cout << "TEST	: PH5 line evaluation float:" << usFloat << "us"
+		<< " fixed:" << usFixed << "us" << endl;
+
+    cout << "TEST	: test_PH5FixedLine() OK " << endl;
+}
+
 int main(int argc, char *argv[]) {
     LOGINFO3("INFO	: FireStep test v%d.%d.%d",
              VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH);
@@ -1935,13 +3426,20 @@ int main(int argc, char *argv[]) {
 
     if (argc > 1 && strcmp("-1", argv[1]) == 0) {
 		test_ph5();
+    } else if (argc > 1 && strcmp("-b", argv[1]) == 0) {
+		test_buildLine_benchmark();
+		test_moveDelta_benchmark();
     } else {
         test_Serial();
         test_Thread();
         test_Quad();
         test_Stroke();
+        test_StrokeCache();
+        test_DeltaCalculator();
+        test_StepEngine();
         test_Machine_step();
         test_Machine();
+        test_homeParallel();
         test_ArduinoJson();
         test_JsonCommand();
         test_JsonController();
@@ -1950,11 +3448,18 @@ int main(int argc, char *argv[]) {
         test_Home();
         test_PrettyPrint();
         test_Idle();
+        test_moveDelta();
+        test_pulse();
         test_Move();
         test_PinConfig();
         test_dvs();
+        test_dvs_stream();
+        test_dvs_feedrate();
         test_errors();
         test_ph5();
+        test_buildLine_benchmark();
+        test_moveDelta_benchmark();
+        test_PH5FixedLine();
     }
 
     cout << "TEST	: END OF TEST main()" << endl;